@@ -7,21 +7,87 @@
  * @copyright Copyright (c) 2022-2024 Marc S. Ressl
  */
 
+#include <charconv>
+#include <cstdio>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
-#include <sqlite3.h>
+#include <memory_resource>
 #include <vector>
-#include <algorithm>
 
 #include "HttpRequestHandler.h"
-#include <sstream>
+#include "Json.h"
 
 using namespace std;
 
-HttpRequestHandler::HttpRequestHandler(string homePath)
+// Cantidad mxima de resultados que se muestran (solo para estos se busca la URL)
+static const size_t MAX_RESULTS = 100;
+
+// Cantidad mxima de consultas en un pedido a /api/msearch
+static const size_t MAX_BATCH_QUERIES = 1000;
+
+// Tamao del buffer de la arena de cada request. Alcanza para una bsqueda tpica
+// sobre www/wiki; si una request necesita ms, la arena pide el resto al heap.
+static const size_t ARENA_SIZE = 256 * 1024;
+
+HttpRequestHandler::HttpRequestHandler(string homePath, string databasePath)
 {
     this->homePath = homePath;
+    this->databasePath = databasePath;
+}
+
+HttpRequestHandler::~HttpRequestHandler()
+{
+    for (auto searchIndex : searchIndexes)
+        delete searchIndex;
+}
+
+/**
+ * @brief Borrows an idle database connection, opening a new one if there is none
+ */
+SearchIndex *HttpRequestHandler::acquireSearchIndex()
+{
+    {
+        lock_guard<mutex> lock(searchIndexesMutex);
+
+        if (!searchIndexes.empty())
+        {
+            SearchIndex *searchIndex = searchIndexes.back();
+            searchIndexes.pop_back();
+
+            return searchIndex;
+        }
+    }
+
+    // Every connection shares the same URLs, loaded by the first one
+    shared_ptr<const UrlTable> urls;
+    {
+        lock_guard<mutex> lock(searchIndexesMutex);
+
+        if (!urlTable || !urlTable->isLoaded())
+            urlTable = make_shared<const UrlTable>(databasePath);
+        urls = urlTable;
+    }
+
+    return new SearchIndex(databasePath, urls);
+}
+
+/**
+ * @brief Returns a connection to the pool. Connections that failed to open are
+ *        dropped, so the next request tries to open the database again.
+ */
+void HttpRequestHandler::releaseSearchIndex(SearchIndex *searchIndex)
+{
+    if (!searchIndex->isOpen())
+    {
+        delete searchIndex;
+
+        return;
+    }
+
+    lock_guard<mutex> lock(searchIndexesMutex);
+
+    searchIndexes.push_back(searchIndex);
 }
 
 /**
@@ -32,7 +98,7 @@ HttpRequestHandler::HttpRequestHandler(string homePath)
  * @return true URL valid
  * @return false URL invalid
  */
-bool HttpRequestHandler::serve(string url, vector<char> &response)
+bool HttpRequestHandler::serve(string_view url, vector<char> &response)
 {
     // Blocks directory traversal
     // e.g. https://www.example.com/show_file.php?file=../../MyFile
@@ -60,195 +126,248 @@ bool HttpRequestHandler::serve(string url, vector<char> &response)
     return true;
 }
 
-bool createFTSTable(sqlite3* db) {
-    const char* createTableQuery = R"(
-        CREATE VIRTUAL TABLE IF NOT EXISTS keyword_index_fts USING fts5(keyword, URL, frequency);
-    )";
-
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db, createTableQuery, -1, &stmt, nullptr) == SQLITE_OK) {
-        if (sqlite3_step(stmt) != SQLITE_DONE) {
-            cerr << "Error al crear la tabla FTS: " << sqlite3_errmsg(db) << endl;
-            sqlite3_finalize(stmt);
-            return false;
-        }
-        sqlite3_finalize(stmt);
-        cout << "Tabla FTS creada correctamente." << endl;
-        return true;
-    }
-    else {
-        cerr << "Error al crear la tabla FTS: " << sqlite3_errmsg(db) << endl;
-        return false;
-    }
+/**
+ * @brief Agrega texto al final de la respuesta, sin strings intermedios
+ */
+static void append(vector<char> &response, string_view text)
+{
+    response.insert(response.end(), text.begin(), text.end());
 }
 
-bool insertDataIntoFTS(sqlite3* db) {
-    const char* insertDataQuery = R"(
-        INSERT INTO keyword_index_fts (keyword, URL, frequency)
-        SELECT keyword, url, frequency FROM keyword_index;
-    )";
-
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db, insertDataQuery, -1, &stmt, nullptr) == SQLITE_OK) {
-        if (sqlite3_step(stmt) != SQLITE_DONE) {
-            cerr << "Error al insertar los datos en la tabla FTS: " << sqlite3_errmsg(db) << endl;
-            sqlite3_finalize(stmt);
-            return false;
-        }
-        sqlite3_finalize(stmt);
-        cout << "Datos insertados en la tabla FTS correctamente." << endl;
-        return true;
-    }
-    else {
-        cerr << "Error al preparar la consulta de insercion: " << sqlite3_errmsg(db) << endl;
-        return false;
-    }
+static void append(vector<char> &response, size_t value)
+{
+    char buffer[24];
+    int length = snprintf(buffer, sizeof(buffer), "%zu", value);
+    append(response, string_view(buffer, length));
 }
 
-bool searchUsingFTS(sqlite3* db, const string& searchString, vector<string>& results) {
-    std::stringstream ss(searchString);
-    std::string word;
-    std::map<string, int> urlFrequencies;
-    std::multimap<int, string> resultsMap;
-    std::string matchQuery;
-
-    urlFrequencies.clear();
-
-    // Construir la consulta para las palabras clave separadas por OR
-    while (ss >> word) {
-        if (!matchQuery.empty()) {
-            matchQuery += " OR ";
-        }
-        matchQuery += "\"" + word + "\"";
+/**
+ * @brief Genera la pgina de resultados de /search
+ *
+ * @param searchString La bsqueda, tal como la escribi el usuario
+ * @param results Los resultados a mostrar
+ * @param totalResults Cantidad total de pginas que coinciden
+ * @param isPartial Si la bsqueda se cort por el deadline
+ * @param searchTime Duracin de la bsqueda, en segundos
+ * @param response Devuelve el HTML
+ */
+void renderSearchPage(string_view searchString,
+    const SearchResults &results,
+    size_t totalResults,
+    bool isPartial,
+    float searchTime,
+    vector<char> &response)
+{
+    // Construccin del HTML con los resultados
+    response.clear();
+    append(response, "<!DOCTYPE html>\
+<html>\
+<head>\
+    <meta charset=\"utf-8\" />\
+    <title>EDAoogle</title>\
+    <link rel=\"preload\" href=\"https://fonts.googleapis.com\" />\
+    <link rel=\"preload\" href=\"https://fonts.gstatic.com\" crossorigin />\
+    <link href=\"https://fonts.googleapis.com/css2?family=Inter:wght@400;800&display=swap\" rel=\"stylesheet\" />\
+    <link rel=\"preload\" href=\"../css/style.css\" />\
+    <link rel=\"stylesheet\" href=\"../css/style.css\" />\
+</head>\
+<body>\
+    <article class=\"edaoogle\">\
+        <div class=\"title\"><a href=\"/\">EDAoogle</a></div>\
+        <div class=\"search\">\
+            <form action=\"/search\" method=\"get\">\
+                <input type=\"text\" name=\"q\" value=\"");
+    append(response, searchString);
+    append(response, "\" autofocus>\
+            </form>\
+        </div>");
+
+    // Muestra los resultados de la bsqueda en el HTML
+    append(response, "<div class=\"results\">");
+    append(response, totalResults);
+    append(response, isPartial ? " partial results (" : " results (");
+    char searchTimeString[32];
+    snprintf(searchTimeString, sizeof(searchTimeString), "%f", searchTime);
+    append(response, searchTimeString);
+    append(response, " seconds):</div>");
+    for (auto& result : results)
+    {
+        append(response, "<div class=\"result\"><a href=\"#\">");
+        append(response, result.url);
+        append(response, "</a></div>");
     }
 
-    const char* query = R"(
-        SELECT URL, frequency
-        FROM keyword_index_fts
-        WHERE keyword MATCH ?
-    )";
+    // Cierra el HTML
+    append(response, "</article>\
+</body>\
+</html>");
+}
 
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) == SQLITE_OK) {        
-        sqlite3_bind_text(stmt, 1, matchQuery.c_str(), -1, SQLITE_STATIC);
+/**
+ * @brief Responde un error del API JSON: {"error": message}
+ */
+static void makeJsonError(HttpResponseHeaders &headers,
+    int statusCode,
+    string_view message,
+    vector<char> &response)
+{
+    headers.statusCode = statusCode;
+    headers.contentType = "application/json";
 
-        while (sqlite3_step(stmt) == SQLITE_ROW) {
-            const char* urlPagina = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));    // url de la pagina que coincide con la entrada
-            int frequency = sqlite3_column_int(stmt, 1);    // frecuencia de la palabra actual en esa url
+    response.clear();
 
-            if (urlPagina) {
-                string url(urlPagina);
-                urlFrequencies[url] += frequency;  // Acumula la frecuencia por URL
-            }
-        }
+    JsonWriter json(response);
+    json.beginObject();
+    json.key("error");
+    json.stringValue(message);
+    json.endObject();
+}
 
-        sqlite3_finalize(stmt);
+/**
+ * @brief Bsqueda en lote para clientes programticos (POST /api/msearch)
+ *
+ * El cuerpo es un arreglo JSON de consultas, p. ej. ["albert einstein", "agujero negro"].
+ * El argumento opcional k limita la cantidad de resultados por consulta. La respuesta es
+ * un arreglo JSON con, para cada consulta en el mismo orden, el total de coincidencias,
+ * si es parcial y los resultados (docId, score y url).
+ *
+ * Los errores tambin se responden en JSON: 405 si el mtodo no es POST, 400 si el
+ * cuerpo o k son invlidos, y 500 si el ndice no est disponible.
+ */
+void HttpRequestHandler::multiSearch(string_view method,
+    const HttpArguments &arguments,
+    string_view body,
+    chrono::steady_clock::time_point deadline,
+    pmr::memory_resource *arena,
+    HttpResponseHeaders &headers,
+    vector<char> &response)
+{
+    if (method != "POST")
+    {
+        headers.allow = "POST";
+        makeJsonError(headers, MHD_HTTP_METHOD_NOT_ALLOWED, "method not allowed, use POST", response);
+        return;
     }
-    else {
-        cerr << "Error al buscar con FTS: " << sqlite3_errmsg(db) << endl;
-        return false;
+
+    pmr::vector<pmr::string> queryStrings(arena);
+    if (!parseJsonStringArray(body, queryStrings))
+    {
+        makeJsonError(headers, MHD_HTTP_BAD_REQUEST, "body must be a JSON array of strings", response);
+        return;
     }
-    // Paso a otro mapa donde la clave sea la frecuencia
-    for (const auto& item : urlFrequencies) {
-        resultsMap.insert({item.second, item.first});
-    }  
-
-    for (auto it = resultsMap.rbegin(); it != resultsMap.rend(); ++it) {
-        results.push_back(it->second);
-        cout << "URL: " << it->second << ", Total Frequency: " << it->first << endl;
+
+    if (queryStrings.size() > MAX_BATCH_QUERIES)
+    {
+        makeJsonError(headers, MHD_HTTP_BAD_REQUEST, "too many queries (at most 1000)", response);
+        return;
     }
 
-    const char* deleteQuery = "DELETE FROM keyword_index_fts;";
-    sqlite3_stmt* stmt3;
-    if (sqlite3_prepare_v2(db, deleteQuery, -1, &stmt3, nullptr) == SQLITE_OK) {
-        if (sqlite3_step(stmt3) != SQLITE_DONE) {
-            cerr << "Error al limpiar el contenido de la tabla FTS: " << sqlite3_errmsg(db) << endl;
-        }
-        else {
-            cout << "Contenido de la tabla FTS limpiado exitosamente." << endl;
+    size_t maxResults = MAX_RESULTS;
+    string_view k = arguments.get("k");
+    if (!k.empty())
+    {
+        auto result = from_chars(k.data(), k.data() + k.size(), maxResults);
+        if (result.ec != errc() || result.ptr != k.data() + k.size() ||
+            maxResults == 0 || maxResults > MAX_RESULTS)
+        {
+            makeJsonError(headers, MHD_HTTP_BAD_REQUEST, "k must be between 1 and 100", response);
+            return;
         }
-        sqlite3_finalize(stmt3);
-    }
-    else {
-        cerr << "Error al preparar la consulta DELETE: " << sqlite3_errmsg(db) << endl;
     }
 
-    return true;
-}
+    SearchQueries queries(arena);
+    queries.reserve(queryStrings.size());
+    for (const auto &queryString : queryStrings)
+        queries.push_back({queryString, SearchResults(arena), 0, false});
 
-bool HttpRequestHandler::handleRequest(string url,
-    HttpArguments arguments,
-    vector<char>& response)
-{
-    string searchPage = "/search";
-    if (url.substr(0, searchPage.size()) == searchPage)
+    SearchIndex *searchIndex = acquireSearchIndex();
+    bool isSearchDone = searchIndex->searchBatch(queries, maxResults, deadline, arena);
+    releaseSearchIndex(searchIndex);
+
+    if (!isSearchDone)
     {
-        string searchString;
-        if (arguments.find("q") != arguments.end())
-            searchString = arguments["q"];
+        makeJsonError(headers, MHD_HTTP_INTERNAL_SERVER_ERROR, "search index unavailable", response);
+        return;
+    }
+
+    headers.statusCode = MHD_HTTP_OK;
+    headers.contentType = "application/json";
 
-        // Conectar a la base de datos SQLite
-        sqlite3* db;
-        if (sqlite3_open("C:/Users/dante/OneDrive/Documentos/git/edaoogle2/search_index.db", &db) != SQLITE_OK)
+    response.clear();
+
+    JsonWriter json(response);
+    json.beginArray();
+    for (const auto &query : queries)
+    {
+        json.beginObject();
+        json.key("query");
+        json.stringValue(query.query);
+        json.key("total");
+        json.numberValue(query.totalResults);
+        json.key("partial");
+        json.boolValue(query.isPartial);
+        json.key("results");
+        json.beginArray();
+        for (const auto &result : query.results)
         {
-            cerr << "Error al abrir la base de datos" << endl;
-            return false;
+            json.beginObject();
+            json.key("docId");
+            json.numberValue(result.docId);
+            json.key("score");
+            json.numberValue(result.score);
+            json.key("url");
+            json.stringValue(result.url);
+            json.endObject();
         }
+        json.endArray();
+        json.endObject();
+    }
+    json.endArray();
+}
 
-        // Vector para almacenar los nombres de las pginas en el orden deseado
-        vector<string> results;
+bool HttpRequestHandler::handleRequest(string_view method,
+    string_view url,
+    const HttpArguments &arguments,
+    string_view body,
+    chrono::steady_clock::time_point deadline,
+    HttpResponseHeaders &headers,
+    vector<char>& response)
+{
+    // Arena de la request: todo lo temporal de la bsqueda sale de este buffer
+    // y se libera de una vez al terminar la request
+    alignas(max_align_t) static thread_local char arenaBuffer[ARENA_SIZE];
+    pmr::monotonic_buffer_resource arena(arenaBuffer, sizeof(arenaBuffer));
 
-        // Crear tabla FTS e insterarle los datos
-        if (!createFTSTable(db)) {      
-            return 1;
-        }
+    if (url == "/api/msearch")
+    {
+        multiSearch(method, arguments, body, deadline, &arena, headers, response);
 
-        if(!insertDataIntoFTS(db)){            
-            return 1;
-        }
+        return true;
+    }
 
-        if(!searchUsingFTS(db, searchString, results)){            
-            return 1;
-        }
+    string_view searchPage = "/search";
+    if (url.substr(0, searchPage.size()) == searchPage)
+    {
+        string_view searchString = arguments.get("q");
 
-        sqlite3_close(db);
+        // Resultados en el orden deseado
+        SearchResults results(&arena);
+        size_t totalResults = 0;
+        bool isPartial = false;
 
-        // Construccin del HTML con los resultados
-        string responseString = "<!DOCTYPE html>\
-<html>\
-<head>\
-    <meta charset=\"utf-8\" />\
-    <title>EDAoogle</title>\
-    <link rel=\"preload\" href=\"https://fonts.googleapis.com\" />\
-    <link rel=\"preload\" href=\"https://fonts.gstatic.com\" crossorigin />\
-    <link href=\"https://fonts.googleapis.com/css2?family=Inter:wght@400;800&display=swap\" rel=\"stylesheet\" />\
-    <link rel=\"preload\" href=\"../css/style.css\" />\
-    <link rel=\"stylesheet\" href=\"../css/style.css\" />\
-</head>\
-<body>\
-    <article class=\"edaoogle\">\
-        <div class=\"title\"><a href=\"/\">EDAoogle</a></div>\
-        <div class=\"search\">\
-            <form action=\"/search\" method=\"get\">\
-                <input type=\"text\" name=\"q\" value=\"" +
-            searchString + "\" autofocus>\
-            </form>\
-        </div>";
+        auto searchStart = chrono::steady_clock::now();
 
-        // Muestra los resultados de la bsqueda en el HTML
-        float searchTime = 0.1F; // Simula el tiempo de bsqueda
-        responseString += "<div class=\"results\">" + to_string(results.size()) +
-            " results (" + to_string(searchTime) + " seconds):</div>";
-        for (auto& result : results)
-            responseString += "<div class=\"result\"><a href=\"#\">" + result + "</a></div>";
+        SearchIndex *searchIndex = acquireSearchIndex();
+        bool isSearchDone = searchIndex->search(searchString, MAX_RESULTS, deadline, &arena,
+                                                results, totalResults, isPartial);
+        releaseSearchIndex(searchIndex);
 
-        // Cierra el HTML
-        responseString += "</article>\
-</body>\
-</html>";
+        if (!isSearchDone)
+            return false;
+
+        chrono::duration<float> searchTime = chrono::steady_clock::now() - searchStart;
 
-        // Convierte `responseString` a `vector<char>` para `response`
-        response.assign(responseString.begin(), responseString.end());
+        renderSearchPage(searchString, results, totalResults, isPartial, searchTime.count(), response);
 
         return true;
     }
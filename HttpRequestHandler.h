@@ -2,7 +2,7 @@
  * @file HttpRequestHandler.h
  * @author Marc S. Ressl
  * @brief EDAoggle search engine
- * @version 0.4
+ * @version 0.9
  *
  * @copyright Copyright (c) 2022-2024 Marc S. Ressl
  */
@@ -10,19 +10,53 @@
 #ifndef HTTPREQUESTHANDLER_H
 #define HTTPREQUESTHANDLER_H
 
+#include <chrono>
+#include <mutex>
+
 #include "HttpServer.h"
+#include "SearchIndex.h"
 
 class HttpRequestHandler
 {
 public:
-    HttpRequestHandler(std::string homePath);
+    HttpRequestHandler(std::string homePath, std::string databasePath);
+    ~HttpRequestHandler();
 
-    bool handleRequest(std::string url, HttpArguments arguments, std::vector<char> &response);
+    bool handleRequest(std::string_view method,
+                       std::string_view url,
+                       const HttpArguments &arguments,
+                       std::string_view body,
+                       std::chrono::steady_clock::time_point deadline,
+                       HttpResponseHeaders &headers,
+                       std::vector<char> &response);
 
 private:
-    bool serve(std::string path, std::vector<char> &response);
+    bool serve(std::string_view path, std::vector<char> &response);
+    void multiSearch(std::string_view method,
+                     const HttpArguments &arguments,
+                     std::string_view body,
+                     std::chrono::steady_clock::time_point deadline,
+                     std::pmr::memory_resource *arena,
+                     HttpResponseHeaders &headers,
+                     std::vector<char> &response);
+
+    SearchIndex *acquireSearchIndex();
+    void releaseSearchIndex(SearchIndex *searchIndex);
 
     std::string homePath;
+    std::string databasePath;
+
+    // Requests run on several threads: each one borrows its own database connection
+    std::mutex searchIndexesMutex;
+    std::vector<SearchIndex *> searchIndexes;
+    std::shared_ptr<const UrlTable> urlTable;
 };
 
+void renderSearchPage(std::string_view searchString,
+                      const SearchResults &results,
+                      size_t totalResults,
+                      bool isPartial,
+                      float searchTime,
+                      std::vector<char> &response);
+
 #endif
@@ -2,16 +2,65 @@
  * @file HttpServer.h
  * @author Marc S. Ressl
  * @brief Simple interface to libmicrohttpd
- * @version 0.3
+ * @version 0.5
  *
  * @copyright Copyright (c) 2022-2024 Marc S. Ressl
  */
 
 #include "HttpServer.h"
 #include "HttpRequestHandler.h"
+#include "RequestExecutor.h"
 
 using namespace std;
 
+// Largest request body accepted (e.g. a /api/msearch batch)
+static const size_t MAX_BODY_SIZE = 1024 * 1024;
+
+HttpArguments::HttpArguments()
+{
+    inlineArgumentsSize = 0;
+}
+
+void HttpArguments::set(string_view key, string_view value)
+{
+    HttpArgument *argument = (HttpArgument *)find(key);
+    if (argument)
+        argument->value = value;
+    else if (inlineArgumentsSize < INLINE_ARGUMENTS)
+        inlineArguments[inlineArgumentsSize++] = {key, value};
+    else
+        extraArguments.push_back({key, value});
+}
+
+bool HttpArguments::has(string_view key) const
+{
+    return find(key) != NULL;
+}
+
+string_view HttpArguments::get(string_view key) const
+{
+    const HttpArgument *argument = find(key);
+
+    return argument ? argument->value : string_view();
+}
+
+const HttpArgument *HttpArguments::find(string_view key) const
+{
+    for (size_t i = 0; i < inlineArgumentsSize; i++)
+    {
+        if (inlineArguments[i].key == key)
+            return &inlineArguments[i];
+    }
+
+    for (auto &argument : extraArguments)
+    {
+        if (argument.key == key)
+            return &argument;
+    }
+
+    return NULL;
+}
+
 /**
  * @brief GetArgument callback for libmicrohttp
  *
@@ -23,23 +72,64 @@ using namespace std;
  *             #MHD_NO to abort the iteration
  */
 static MHD_Result httpGetArgumentCallback(void *cls,
-                                          enum MHD_ValueKind kind,
+                                          enum MHD_ValueKind /* kind */,
                                           const char *key,
                                           const char *value)
 {
     HttpArguments *arguments = (HttpArguments *)cls;
 
+    // libmicrohttpd keeps keys and values alive until the connection is done
     if (value != NULL)
-        (*arguments)[key] = value;
+        arguments->set(key, value);
     else
-        (*arguments)[key] = "";
+        arguments->set(key, "");
 
     return MHD_YES;
 }
 
+/**
+ * @brief State of a request while it goes through the executor
+ */
+struct HttpRequest
+{
+    enum Stage
+    {
+        NEW,
+        RUNNING,
+        DONE,
+    };
+
+    Stage stage;
+    chrono::steady_clock::time_point deadline;
+
+    string method;
+    string url;
+    HttpArguments arguments;
+    string body;
+    bool isBodyTooLarge;
+
+    HttpResponseHeaders headers;
+    vector<char> response;
+};
+
+/**
+ * @brief Builds a small HTML error page
+ */
+static void makeErrorResponse(HttpRequest *request, int statusCode, const string &message)
+{
+    request->headers = {statusCode, NULL, NULL};
+
+    string errorResponse = "<html><body><h1>" + message + "</h1></body></html>";
+    request->response.assign(errorResponse.begin(), errorResponse.end());
+}
+
 /**
  * @brief HTTP request handler for libmicrohttpd
  *
+ * Requests are handled by the executor threads while the connection is suspended,
+ * so the libmicrohttpd thread never waits for a search. When the executor queue
+ * is full, the request is rejected right away with 503.
+ *
  * @param cls The server object
  * @param connection The connection
  * @param url The URL
@@ -54,7 +144,7 @@ MHD_Result httpRequestHandlerCallback(void *cls,
                                       struct MHD_Connection *connection,
                                       const char *url,
                                       const char *method,
-                                      const char *version,
+                                      const char * /* version */,
                                       const char *upload_data,
                                       size_t *upload_data_size,
                                       void **con_cls)
@@ -62,64 +152,151 @@ MHD_Result httpRequestHandlerCallback(void *cls,
     HttpServer *server = (HttpServer *)cls;
 
     // Headers are invalid on first call, wait for second call.
-    if (con_cls == NULL)
+    if (*con_cls == NULL)
     {
-        *con_cls = cls;
+        HttpRequest *request = new HttpRequest();
+        request->stage = HttpRequest::NEW;
+        request->isBodyTooLarge = false;
+        request->deadline = chrono::steady_clock::now() + server->queryTimeout;
+        *con_cls = request;
 
         return MHD_YES;
     }
 
-    // We only handle get requests
-    if ((string(method) == "GET"))
+    HttpRequest *request = (HttpRequest *)*con_cls;
+
+    if (request->stage == HttpRequest::NEW && *upload_data_size > 0)
+    {
+        // The body may arrive over several calls
+        if (request->body.size() + *upload_data_size <= MAX_BODY_SIZE)
+            request->body.append(upload_data, *upload_data_size);
+        else
+            request->isBodyTooLarge = true;
+
+        *upload_data_size = 0;
+
+        return MHD_YES;
+    }
+
+    if (request->stage == HttpRequest::NEW && request->isBodyTooLarge)
+    {
+        makeErrorResponse(request, MHD_HTTP_PAYLOAD_TOO_LARGE, "413 Payload Too Large");
+
+        request->stage = HttpRequest::DONE;
+    }
+
+    // We only handle get and post requests
+    string_view methodName = method;
+    if (request->stage == HttpRequest::NEW && methodName != "GET" && methodName != "POST")
+    {
+        makeErrorResponse(request, MHD_HTTP_METHOD_NOT_ALLOWED, "405 Method Not Allowed");
+        request->headers.allow = "GET, POST";
+
+        request->stage = HttpRequest::DONE;
+    }
+
+    if (request->stage == HttpRequest::NEW)
     {
         // Get arguments
-        HttpArguments arguments;
-        MHD_get_connection_values(connection, MHD_GET_ARGUMENT_KIND, httpGetArgumentCallback, &arguments);
+        MHD_get_connection_values(connection, MHD_GET_ARGUMENT_KIND, httpGetArgumentCallback, &request->arguments);
 
-        // Make response
-        int statusCode;
-        vector<char> response;
+        request->method = method;
 
         // Clean URL
-        string cleanedUrl = url;
-        if (cleanedUrl == "")
-            cleanedUrl = "/";
+        request->url = url;
+        if (request->url == "")
+            request->url = "/";
 
         // Convert directories to files
-        if (cleanedUrl.back() == '/')
-            cleanedUrl += "index.html";
+        if (request->url.back() == '/')
+            request->url += "index.html";
 
-        if (server->httpRequestHandler &&
-            server->httpRequestHandler->handleRequest(cleanedUrl, arguments, response))
-            statusCode = MHD_HTTP_FOUND;
-        else
+        // The connection must be suspended before a worker can resume it
+        request->stage = HttpRequest::RUNNING;
+        MHD_suspend_connection(connection);
+
+        bool isSubmitted = server->executor->submit([server, connection, request]()
         {
-            statusCode = MHD_HTTP_NOT_FOUND;
+            // Pages keep the defaults; the handler overrides them for the JSON API
+            request->headers = {MHD_HTTP_FOUND, NULL, NULL};
 
-            string errorResponse = "<html><body><h1>404 Not Found</h1></body></html>";
-            response.assign(errorResponse.begin(), errorResponse.end());
-        }
+            if (!server->httpRequestHandler ||
+                !server->httpRequestHandler->handleRequest(request->method,
+                                                           request->url,
+                                                           request->arguments,
+                                                           request->body,
+                                                           request->deadline,
+                                                           request->headers,
+                                                           request->response))
+                makeErrorResponse(request, MHD_HTTP_NOT_FOUND, "404 Not Found");
 
-        MHD_Response *mhdResponse = MHD_create_response_from_buffer(response.size(),
-                                                                    (void *)response.data(),
-                                                                    MHD_RESPMEM_MUST_COPY);
-        bool isResponseQueued = MHD_queue_response(connection, statusCode, mhdResponse);
-        MHD_destroy_response(mhdResponse);
+            request->stage = HttpRequest::DONE;
+            MHD_resume_connection(connection);
+        });
 
-        return isResponseQueued ? MHD_YES : MHD_NO;
+        if (!isSubmitted)
+        {
+            makeErrorResponse(request, MHD_HTTP_SERVICE_UNAVAILABLE, "503 Service Unavailable");
+
+            request->stage = HttpRequest::DONE;
+            MHD_resume_connection(connection);
+        }
+
+        return MHD_YES;
     }
 
-    return MHD_NO;
+    if (request->stage == HttpRequest::RUNNING)
+        return MHD_YES;
+
+    MHD_Response *mhdResponse = MHD_create_response_from_buffer(request->response.size(),
+                                                                (void *)request->response.data(),
+                                                                MHD_RESPMEM_MUST_COPY);
+    if (request->headers.contentType)
+        MHD_add_response_header(mhdResponse, MHD_HTTP_HEADER_CONTENT_TYPE, request->headers.contentType);
+    if (request->headers.allow)
+        MHD_add_response_header(mhdResponse, MHD_HTTP_HEADER_ALLOW, request->headers.allow);
+    if (request->headers.statusCode == MHD_HTTP_SERVICE_UNAVAILABLE)
+        MHD_add_response_header(mhdResponse, MHD_HTTP_HEADER_RETRY_AFTER, "1");
+    bool isResponseQueued = MHD_queue_response(connection, request->headers.statusCode, mhdResponse);
+    MHD_destroy_response(mhdResponse);
+
+    return isResponseQueued ? MHD_YES : MHD_NO;
 }
 
-HttpServer::HttpServer(int port)
+/**
+ * @brief Request completed callback for libmicrohttpd: frees the request state
+ */
+static void httpRequestCompletedCallback(void * /* cls */,
+                                         struct MHD_Connection * /* connection */,
+                                         void **con_cls,
+                                         enum MHD_RequestTerminationCode /* toe */)
 {
-    daemon = MHD_start_daemon(MHD_USE_INTERNAL_POLLING_THREAD,
-                              8000,
+    delete (HttpRequest *)*con_cls;
+    *con_cls = NULL;
+}
+
+/**
+ * @brief Starts the server
+ *
+ * @param port The TCP port
+ * @param workerCount Number of threads that handle requests
+ * @param queueCapacity Requests that may wait for a worker before new ones get 503
+ * @param queryTimeout Time a request has (from arrival) before searches return partial results
+ */
+HttpServer::HttpServer(int port, int workerCount, int queueCapacity, chrono::milliseconds queryTimeout)
+{
+    this->queryTimeout = queryTimeout;
+    executor = new RequestExecutor(workerCount, queueCapacity);
+
+    daemon = MHD_start_daemon(MHD_USE_INTERNAL_POLLING_THREAD | MHD_ALLOW_SUSPEND_RESUME,
+                              port,
                               NULL,
                               NULL,
                               httpRequestHandlerCallback,
                               this,
+                              MHD_OPTION_NOTIFY_COMPLETED,
+                              httpRequestCompletedCallback,
+                              NULL,
                               MHD_OPTION_END);
 
     httpRequestHandler = NULL;
@@ -127,9 +304,14 @@ HttpServer::HttpServer(int port)
 
 HttpServer::~HttpServer()
 {
+    // Workers resume their connections, so they must finish before the daemon stops
+    executor->stop();
+
     if (daemon)
         MHD_stop_daemon(daemon);
 
+    delete executor;
+
     httpRequestHandler = NULL;
 }
 
@@ -2,7 +2,7 @@
  * @file HttpServer.h
  * @author Marc S. Ressl
  * @brief Simple interface to libmicrohttpd
- * @version 0.3
+ * @version 0.5
  *
  * @copyright Copyright (c) 2022-2024 Marc S. Ressl
  */
@@ -12,18 +12,61 @@
 
 #include <microhttpd.h>
 
-#include <map>
+#include <chrono>
 #include <string>
+#include <string_view>
 #include <vector>
 
-typedef std::map<std::string, std::string> HttpArguments;
+struct HttpArgument
+{
+    std::string_view key;
+    std::string_view value;
+};
+
+/**
+ * @brief Request arguments, stored flat as views into libmicrohttpd's buffers
+ *        (valid while the request is being handled)
+ */
+class HttpArguments
+{
+public:
+    HttpArguments();
+
+    void set(std::string_view key, std::string_view value);
+    bool has(std::string_view key) const;
+    std::string_view get(std::string_view key) const;
+
+private:
+    const HttpArgument *find(std::string_view key) const;
+
+    // Requests rarely carry more than a few arguments: these don't allocate
+    static const size_t INLINE_ARGUMENTS = 8;
+
+    HttpArgument inlineArguments[INLINE_ARGUMENTS];
+    size_t inlineArgumentsSize;
+    std::vector<HttpArgument> extraArguments;
+};
+
+/**
+ * @brief Status and headers of a response, as set by the request handler
+ */
+struct HttpResponseHeaders
+{
+    int statusCode;
+    const char *contentType;    // NULL: no Content-Type header
+    const char *allow;          // Allowed methods, for 405 (NULL: no Allow header)
+};
 
 class HttpRequestHandler;
+class RequestExecutor;
 
 class HttpServer
 {
 public:
-    HttpServer(int port);
+    HttpServer(int port,
+               int workerCount = 4,
+               int queueCapacity = 64,
+               std::chrono::milliseconds queryTimeout = std::chrono::milliseconds(250));
     ~HttpServer();
 
     bool isRunning();
@@ -32,6 +75,8 @@ public:
 private:
     MHD_Daemon *daemon;
     HttpRequestHandler *httpRequestHandler;
+    RequestExecutor *executor;
+    std::chrono::milliseconds queryTimeout;
 
     // Grants private access to libmicrohttp callback
     friend MHD_Result httpRequestHandlerCallback(void *cls, struct MHD_Connection *connection,
@@ -0,0 +1,125 @@
+/**
+ * @file IndexBuilder.cpp
+ * @author Marc S. Ressl
+ * @brief Text extraction and schema for the database index
+ * @version 0.1
+ *
+ * @copyright Copyright (c) 2022-2024 Marc S. Ressl
+ */
+
+#include <iostream>
+#include <fstream>
+
+#include "IndexBuilder.h"
+
+using namespace std;
+
+bool crearTablas(sqlite3* db) {
+	char* errMsg = 0;
+	const char* sql;
+
+	// El ndice se reconstruye desde cero: los ids de trminos y documentos se asignan en esta corrida.
+	// Tambin se descartan las tablas del esquema anterior (keyword_index y keyword_index_fts).
+	sql = "DROP TABLE IF EXISTS keyword_index_fts;"
+		"DROP TABLE IF EXISTS keyword_index;"
+		"DROP TABLE IF EXISTS postings;"
+		"DROP TABLE IF EXISTS terms;"
+		"DROP TABLE IF EXISTS documents;";
+
+	if (sqlite3_exec(db, sql, 0, 0, &errMsg) != SQLITE_OK) {
+		cout << "Error al borrar las tablas anteriores: " << errMsg << endl;
+		sqlite3_free(errMsg);
+	}
+
+	// Esquema normalizado: cada URL y cada palabra se guardan una sola vez, y los postings
+	// referencian ambos por id entero. postings es WITHOUT ROWID, as que la tabla misma es
+	// el B-tree ordenado por (term_id, doc_id) y una bsqueda por trmino es un nico recorrido.
+	// terms tambin es WITHOUT ROWID con clave term: buscar una palabra devuelve term_id y df
+	// desde el mismo B-tree, sin pasar por un ndice aparte.
+	sql = "CREATE TABLE documents ("
+		"doc_id INTEGER PRIMARY KEY, "
+		"url TEXT NOT NULL, "
+		"title TEXT NOT NULL, "
+		"length INTEGER NOT NULL);"
+		"CREATE TABLE terms ("
+		"term_id INTEGER NOT NULL UNIQUE, "
+		"term TEXT NOT NULL PRIMARY KEY, "
+		"df INTEGER NOT NULL) WITHOUT ROWID;"
+		"CREATE TABLE postings ("
+		"term_id INTEGER NOT NULL, "
+		"doc_id INTEGER NOT NULL, "
+		"frequency INTEGER NOT NULL, "
+		"PRIMARY KEY (term_id, doc_id)) WITHOUT ROWID;";
+
+	if (sqlite3_exec(db, sql, 0, 0, &errMsg) != SQLITE_OK) {
+		cout << "Error al crear las tablas: " << errMsg << endl;
+		sqlite3_free(errMsg);
+		return false;
+	}
+
+	return true;
+}
+
+map<string, int> extraerPalabras(const string& nombreArchivo) {
+	ifstream archivo(nombreArchivo);
+	map<string, int> frecuenciaPalabras;
+	string linea;
+	char brackets = 0;
+
+	// Leer el archivo lnea por lnea
+	while (getline(archivo, linea)) {
+		string palabra;
+
+		// Recorrer cada carcter en la lnea
+		for (char& ch : linea) {
+			if (ch == '<') {
+				brackets = 1;
+				continue;
+			}
+			else if (ch == '>') {
+				brackets = 0;
+				continue;
+			}
+
+			// Si estamos dentro de una etiqueta, ignoramos el carcter
+			if (brackets == 1) {
+				continue;
+			}
+
+			if (isalpha(static_cast<unsigned char>(ch))) {
+				palabra += tolower(static_cast<unsigned char>(ch));
+			}
+			else if (!palabra.empty()) {
+				// Si no es una letra y tenemos caracteres en la palabra, pasamos a terminar de evaluarla
+				frecuenciaPalabras[palabra]++;
+				palabra.clear(); // Reiniciar la palabra
+			}
+		}
+
+		// Captura la ltima palabra en la lnea (por si el ultimo caracter fue una letra)
+		if (!palabra.empty()) {
+			frecuenciaPalabras[palabra]++;
+		}
+	}
+
+	return frecuenciaPalabras;
+}
+
+string extraerTitulo(const string& nombreArchivo) {
+	ifstream archivo(nombreArchivo);
+	string linea;
+
+	// El ttulo est en el <head>, as que alcanza con leer hasta encontrar la etiqueta
+	while (getline(archivo, linea)) {
+		size_t inicio = linea.find("<title>");
+		if (inicio == string::npos)
+			continue;
+
+		inicio += string("<title>").size();
+		size_t fin = linea.find("</title>", inicio);
+
+		return linea.substr(inicio, fin == string::npos ? string::npos : fin - inicio);
+	}
+
+	return "";
+}
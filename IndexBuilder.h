@@ -0,0 +1,23 @@
+/**
+ * @file IndexBuilder.h
+ * @author Marc S. Ressl
+ * @brief Text extraction and schema for the database index
+ * @version 0.1
+ *
+ * @copyright Copyright (c) 2022-2024 Marc S. Ressl
+ */
+
+#ifndef INDEXBUILDER_H
+#define INDEXBUILDER_H
+
+#include <map>
+#include <string>
+
+#include <sqlite3.h>
+
+bool crearTablas(sqlite3* db);
+
+std::map<std::string, int> extraerPalabras(const std::string& archivo);
+std::string extraerTitulo(const std::string& archivo);
+
+#endif
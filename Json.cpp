@@ -0,0 +1,310 @@
+/**
+ * @file Json.cpp
+ * @author Marc S. Ressl
+ * @brief Minimal JSON reader and writer for the EDAoogle API
+ * @version 0.1
+ *
+ * @copyright Copyright (c) 2022-2024 Marc S. Ressl
+ */
+
+#include <charconv>
+
+#include "Json.h"
+
+using namespace std;
+
+static void skipWhitespace(string_view json, size_t &i)
+{
+    while (i < json.size() &&
+           (json[i] == ' ' || json[i] == '\t' || json[i] == '\n' || json[i] == '\r'))
+        i++;
+}
+
+static bool parseHex(string_view json, size_t i, unsigned int &value)
+{
+    if (i + 4 > json.size())
+        return false;
+
+    auto result = from_chars(json.data() + i, json.data() + i + 4, value, 16);
+
+    return result.ec == errc() && result.ptr == json.data() + i + 4;
+}
+
+static void appendUtf8(pmr::string &text, unsigned int codePoint)
+{
+    if (codePoint < 0x80)
+        text += (char)codePoint;
+    else if (codePoint < 0x800)
+    {
+        text += (char)(0xc0 | (codePoint >> 6));
+        text += (char)(0x80 | (codePoint & 0x3f));
+    }
+    else if (codePoint < 0x10000)
+    {
+        text += (char)(0xe0 | (codePoint >> 12));
+        text += (char)(0x80 | ((codePoint >> 6) & 0x3f));
+        text += (char)(0x80 | (codePoint & 0x3f));
+    }
+    else
+    {
+        text += (char)(0xf0 | (codePoint >> 18));
+        text += (char)(0x80 | ((codePoint >> 12) & 0x3f));
+        text += (char)(0x80 | ((codePoint >> 6) & 0x3f));
+        text += (char)(0x80 | (codePoint & 0x3f));
+    }
+}
+
+/**
+ * @brief Parses a JSON string starting at the opening quote
+ */
+static bool parseJsonString(string_view json, size_t &i, pmr::string &text)
+{
+    if (i >= json.size() || json[i] != '"')
+        return false;
+    i++;
+
+    while (i < json.size())
+    {
+        char ch = json[i++];
+
+        if (ch == '"')
+            return true;
+        else if ((unsigned char)ch < 0x20)
+            return false;
+        else if (ch != '\\')
+        {
+            text += ch;
+            continue;
+        }
+
+        if (i >= json.size())
+            return false;
+
+        switch (json[i++])
+        {
+        case '"':
+            text += '"';
+            break;
+        case '\\':
+            text += '\\';
+            break;
+        case '/':
+            text += '/';
+            break;
+        case 'b':
+            text += '\b';
+            break;
+        case 'f':
+            text += '\f';
+            break;
+        case 'n':
+            text += '\n';
+            break;
+        case 'r':
+            text += '\r';
+            break;
+        case 't':
+            text += '\t';
+            break;
+        case 'u':
+        {
+            unsigned int codePoint;
+            if (!parseHex(json, i, codePoint))
+                return false;
+            i += 4;
+
+            // Surrogate pair
+            if (codePoint >= 0xd800 && codePoint < 0xdc00)
+            {
+                unsigned int lowSurrogate;
+                if (i + 1 >= json.size() || json[i] != '\\' || json[i + 1] != 'u' ||
+                    !parseHex(json, i + 2, lowSurrogate) ||
+                    lowSurrogate < 0xdc00 || lowSurrogate >= 0xe000)
+                    return false;
+                i += 6;
+
+                codePoint = 0x10000 + ((codePoint - 0xd800) << 10) + (lowSurrogate - 0xdc00);
+            }
+            // A low surrogate on its own is not a character (and would not be valid UTF-8)
+            else if (codePoint >= 0xdc00 && codePoint < 0xe000)
+                return false;
+
+            appendUtf8(text, codePoint);
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Parses a JSON array of strings, e.g. ["albert einstein", "agujero negro"]
+ *
+ * @param json The JSON text
+ * @param strings Returns the strings, allocated with the vector's allocator
+ * @return true Valid array of strings
+ * @return false Invalid JSON, or not an array of strings
+ */
+bool parseJsonStringArray(string_view json, pmr::vector<pmr::string> &strings)
+{
+    size_t i = 0;
+
+    skipWhitespace(json, i);
+    if (i >= json.size() || json[i] != '[')
+        return false;
+    i++;
+
+    skipWhitespace(json, i);
+    if (i < json.size() && json[i] == ']')
+        i++;
+    else
+    {
+        while (true)
+        {
+            skipWhitespace(json, i);
+
+            strings.emplace_back();
+            if (!parseJsonString(json, i, strings.back()))
+                return false;
+
+            skipWhitespace(json, i);
+            if (i >= json.size())
+                return false;
+
+            char ch = json[i++];
+            if (ch == ']')
+                break;
+            else if (ch != ',')
+                return false;
+        }
+    }
+
+    skipWhitespace(json, i);
+
+    return i == json.size();
+}
+
+JsonWriter::JsonWriter(vector<char> &output) : output(output)
+{
+    depth = 0;
+    isFirstValue[0] = true;
+    isAfterKey = false;
+}
+
+void JsonWriter::beginArray()
+{
+    beginValue();
+    append("[");
+
+    if (depth + 1 < MAX_DEPTH)
+        isFirstValue[++depth] = true;
+}
+
+void JsonWriter::endArray()
+{
+    append("]");
+
+    if (depth > 0)
+        depth--;
+}
+
+void JsonWriter::beginObject()
+{
+    beginValue();
+    append("{");
+
+    if (depth + 1 < MAX_DEPTH)
+        isFirstValue[++depth] = true;
+}
+
+void JsonWriter::endObject()
+{
+    append("}");
+
+    if (depth > 0)
+        depth--;
+}
+
+void JsonWriter::key(string_view name)
+{
+    stringValue(name);
+    append(":");
+
+    isAfterKey = true;
+}
+
+void JsonWriter::stringValue(string_view text)
+{
+    static const char hexDigits[] = "0123456789abcdef";
+
+    beginValue();
+    append("\"");
+
+    // Copies runs of plain characters at once, escaping only what JSON requires
+    size_t runStart = 0;
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        unsigned char ch = text[i];
+        if (ch >= 0x20 && ch != '"' && ch != '\\')
+            continue;
+
+        append(text.substr(runStart, i - runStart));
+        runStart = i + 1;
+
+        if (ch == '"')
+            append("\\\"");
+        else if (ch == '\\')
+            append("\\\\");
+        else if (ch == '\n')
+            append("\\n");
+        else if (ch == '\r')
+            append("\\r");
+        else if (ch == '\t')
+            append("\\t");
+        else
+        {
+            char escape[] = {'\\', 'u', '0', '0', hexDigits[ch >> 4], hexDigits[ch & 0xf]};
+            append(string_view(escape, sizeof(escape)));
+        }
+    }
+    append(text.substr(runStart));
+
+    append("\"");
+}
+
+void JsonWriter::numberValue(long long number)
+{
+    char buffer[24];
+    auto result = to_chars(buffer, buffer + sizeof(buffer), number);
+
+    beginValue();
+    append(string_view(buffer, result.ptr - buffer));
+}
+
+void JsonWriter::boolValue(bool boolean)
+{
+    beginValue();
+    append(boolean ? "true" : "false");
+}
+
+void JsonWriter::beginValue()
+{
+    if (isAfterKey)
+    {
+        isAfterKey = false;
+        return;
+    }
+
+    if (!isFirstValue[depth])
+        append(",");
+
+    isFirstValue[depth] = false;
+}
+
+void JsonWriter::append(string_view text)
+{
+    output.insert(output.end(), text.begin(), text.end());
+}
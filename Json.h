@@ -0,0 +1,51 @@
+/**
+ * @file Json.h
+ * @author Marc S. Ressl
+ * @brief Minimal JSON reader and writer for the EDAoogle API
+ * @version 0.1
+ *
+ * @copyright Copyright (c) 2022-2024 Marc S. Ressl
+ */
+
+#ifndef JSON_H
+#define JSON_H
+
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+
+bool parseJsonStringArray(std::string_view json, std::pmr::vector<std::pmr::string> &strings);
+
+/**
+ * @brief Streaming JSON writer: appends straight to the output buffer, without
+ *        building intermediate strings. Commas between values are added automatically.
+ */
+class JsonWriter
+{
+public:
+    JsonWriter(std::vector<char> &output);
+
+    void beginArray();
+    void endArray();
+    void beginObject();
+    void endObject();
+
+    void key(std::string_view name);
+    void stringValue(std::string_view text);
+    void numberValue(long long number);
+    void boolValue(bool boolean);
+
+private:
+    void beginValue();
+    void append(std::string_view text);
+
+    static const int MAX_DEPTH = 32;
+
+    std::vector<char> &output;
+    bool isFirstValue[MAX_DEPTH];
+    int depth;
+    bool isAfterKey;
+};
+
+#endif
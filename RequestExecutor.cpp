@@ -0,0 +1,99 @@
+/**
+ * @file RequestExecutor.cpp
+ * @author Marc S. Ressl
+ * @brief Bounded thread pool for request handling
+ * @version 0.1
+ *
+ * @copyright Copyright (c) 2022-2024 Marc S. Ressl
+ */
+
+#include "RequestExecutor.h"
+
+using namespace std;
+
+/**
+ * @brief Starts the worker threads
+ *
+ * @param threadCount Worker threads (at least 1: without workers every job is rejected)
+ * @param queueCapacity Jobs that may wait for a worker (negative counts as 0)
+ */
+RequestExecutor::RequestExecutor(int threadCount, int queueCapacity)
+{
+    this->queueCapacity = queueCapacity > 0 ? queueCapacity : 0;
+    isStopping = false;
+
+    for (int i = 0; i < threadCount; i++)
+        threads.emplace_back(&RequestExecutor::run, this);
+}
+
+RequestExecutor::~RequestExecutor()
+{
+    stop();
+}
+
+/**
+ * @brief Queues a job for the worker threads
+ *
+ * @param job The job
+ * @return true Job queued
+ * @return false Queue full (or executor stopped): the caller should shed the request
+ */
+bool RequestExecutor::submit(function<void()> job)
+{
+    {
+        lock_guard<std::mutex> lock(mutex);
+
+        // Without workers, a queued job would never run
+        if (isStopping || threads.empty() || queue.size() >= queueCapacity)
+            return false;
+
+        queue.push_back(move(job));
+    }
+
+    queueChanged.notify_one();
+
+    return true;
+}
+
+/**
+ * @brief Stops accepting jobs, runs the ones already queued and joins the worker threads
+ */
+void RequestExecutor::stop()
+{
+    {
+        lock_guard<std::mutex> lock(mutex);
+
+        isStopping = true;
+    }
+
+    queueChanged.notify_all();
+
+    for (auto &thread : threads)
+    {
+        if (thread.joinable())
+            thread.join();
+    }
+}
+
+void RequestExecutor::run()
+{
+    while (true)
+    {
+        function<void()> job;
+
+        {
+            unique_lock<std::mutex> lock(mutex);
+
+            queueChanged.wait(lock, [this]
+                              { return isStopping || !queue.empty(); });
+
+            if (queue.empty())
+                return;
+
+            job = move(queue.front());
+            queue.pop_front();
+        }
+
+        job();
+    }
+}
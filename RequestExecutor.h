@@ -0,0 +1,41 @@
+/**
+ * @file RequestExecutor.h
+ * @author Marc S. Ressl
+ * @brief Bounded thread pool for request handling
+ * @version 0.1
+ *
+ * @copyright Copyright (c) 2022-2024 Marc S. Ressl
+ */
+
+#ifndef REQUESTEXECUTOR_H
+#define REQUESTEXECUTOR_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class RequestExecutor
+{
+public:
+    RequestExecutor(int threadCount, int queueCapacity);
+    ~RequestExecutor();
+
+    bool submit(std::function<void()> job);
+    void stop();
+
+private:
+    void run();
+
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()>> queue;
+    size_t queueCapacity;
+    bool isStopping;
+
+    std::mutex mutex;
+    std::condition_variable queueChanged;
+};
+
+#endif
@@ -0,0 +1,358 @@
+/**
+ * @file SearchIndex.cpp
+ * @author Marc S. Ressl
+ * @brief EDAoogle search index
+ * @version 0.5
+ *
+ * @copyright Copyright (c) 2022-2024 Marc S. Ressl
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <unordered_map>
+
+#include "SearchIndex.h"
+
+using namespace std;
+
+/**
+ * @brief Carga las URLs de todos los documentos en un solo buffer, as buscar la URL de
+ *        un resultado no toca la base de datos ni pide memoria
+ */
+UrlTable::UrlTable(const string &databasePath)
+{
+    sqlite3 *db;
+    if (sqlite3_open_v2(databasePath.c_str(), &db, SQLITE_OPEN_READONLY, NULL) == SQLITE_OK)
+    {
+        sqlite3_stmt *documentsStmt;
+        if (sqlite3_prepare_v2(db, "SELECT doc_id, url FROM documents ORDER BY doc_id", -1,
+                               &documentsStmt, NULL) == SQLITE_OK)
+        {
+            urlOffsets.push_back(0);
+            while (sqlite3_step(documentsStmt) == SQLITE_ROW)
+            {
+                size_t docId = sqlite3_column_int(documentsStmt, 0);
+                if (urlOffsets.size() <= docId)
+                    urlOffsets.resize(docId + 1, urls.size());
+
+                urls.append(reinterpret_cast<const char *>(sqlite3_column_text(documentsStmt, 1)),
+                            sqlite3_column_bytes(documentsStmt, 1));
+                urlOffsets.push_back(urls.size());
+            }
+        }
+        sqlite3_finalize(documentsStmt);
+    }
+    sqlite3_close(db);
+}
+
+bool UrlTable::isLoaded() const
+{
+    return !urlOffsets.empty();
+}
+
+/**
+ * @brief Devuelve la URL de un documento (vaca si no existe)
+ */
+string_view UrlTable::getUrl(int docId) const
+{
+    if (docId < 0 || (size_t)docId + 1 >= urlOffsets.size())
+        return string_view();
+
+    return string_view(urls).substr(urlOffsets[docId], urlOffsets[docId + 1] - urlOffsets[docId]);
+}
+
+/**
+ * @brief Abre el ndice
+ *
+ * @param databasePath La base de datos
+ * @param urlTable Las URLs, compartidas con otras conexiones (si no se pasa, se cargan ac)
+ */
+SearchIndex::SearchIndex(const string &databasePath, shared_ptr<const UrlTable> urlTable)
+{
+    termStmt = NULL;
+    postingsStmt = NULL;
+
+    if (sqlite3_open_v2(databasePath.c_str(), &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK)
+    {
+        cerr << "Error al abrir la base de datos: " << sqlite3_errmsg(db) << endl;
+        sqlite3_close(db);
+        db = NULL;
+
+        return;
+    }
+
+    // Las consultas se preparan una sola vez; cada bsqueda solo hace bind/step/reset
+    if (sqlite3_prepare_v3(db, "SELECT term_id, df FROM terms WHERE term = ?", -1,
+                           SQLITE_PREPARE_PERSISTENT, &termStmt, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v3(db, "SELECT doc_id, frequency FROM postings WHERE term_id = ?", -1,
+                           SQLITE_PREPARE_PERSISTENT, &postingsStmt, NULL) != SQLITE_OK)
+    {
+        cerr << "Error al preparar la bsqueda: " << sqlite3_errmsg(db) << endl;
+        sqlite3_finalize(termStmt);
+        sqlite3_finalize(postingsStmt);
+        sqlite3_close(db);
+        db = NULL;
+
+        return;
+    }
+
+    if (!urlTable)
+        urlTable = make_shared<const UrlTable>(databasePath);
+    this->urlTable = urlTable;
+}
+
+SearchIndex::~SearchIndex()
+{
+    if (db)
+    {
+        sqlite3_finalize(termStmt);
+        sqlite3_finalize(postingsStmt);
+        sqlite3_close(db);
+    }
+}
+
+bool SearchIndex::isOpen()
+{
+    return db != NULL;
+}
+
+/**
+ * @brief Busca el id de una palabra
+ *
+ * @param term La palabra (en minscula)
+ * @param termId Devuelve el term_id
+ * @param df Devuelve la cantidad de documentos en los que aparece
+ * @return true La palabra est en el ndice
+ * @return false La palabra no est en el ndice
+ */
+bool SearchIndex::lookupTerm(string_view term, int &termId, int &df)
+{
+    bool found = false;
+
+    sqlite3_bind_text(termStmt, 1, term.data(), (int)term.size(), SQLITE_STATIC);
+    if (sqlite3_step(termStmt) == SQLITE_ROW)
+    {
+        termId = sqlite3_column_int(termStmt, 0);
+        df = sqlite3_column_int(termStmt, 1);
+        found = true;
+    }
+    sqlite3_reset(termStmt);
+
+    return found;
+}
+
+/**
+ * @brief Agrega los postings (doc_id, frecuencia) de un trmino al final de postings
+ */
+void SearchIndex::readPostings(int termId, pmr::vector<pair<int, int>> &postings)
+{
+    sqlite3_bind_int(postingsStmt, 1, termId);
+    while (sqlite3_step(postingsStmt) == SQLITE_ROW)
+        postings.emplace_back(sqlite3_column_int(postingsStmt, 0), sqlite3_column_int(postingsStmt, 1));
+    sqlite3_reset(postingsStmt);
+}
+
+/**
+ * @brief Devuelve la URL de un documento (vaca si no existe)
+ */
+string_view SearchIndex::getUrl(int docId)
+{
+    return urlTable->getUrl(docId);
+}
+
+/**
+ * @brief Busca las pginas que contienen alguna de las palabras de la consulta
+ *
+ * Es una bsqueda en lote de una sola consulta (ver searchBatch).
+ *
+ * @param query La consulta tal como la escribi el usuario
+ * @param maxResults Cantidad mxima de resultados (solo para estos se busca la URL)
+ * @param deadline Momento a partir del cual se devuelven resultados parciales
+ * @param arena Memoria de la request
+ * @param results Devuelve los resultados ordenados por frecuencia total
+ * @param totalResults Devuelve la cantidad total de pginas que coinciden
+ * @param isPartial Devuelve si la bsqueda se cort por el deadline
+ * @return true Bsqueda realizada
+ * @return false ndice no disponible
+ */
+bool SearchIndex::search(string_view query,
+                         size_t maxResults,
+                         chrono::steady_clock::time_point deadline,
+                         pmr::memory_resource *arena,
+                         SearchResults &results,
+                         size_t &totalResults,
+                         bool &isPartial)
+{
+    SearchQueries queries(arena);
+    queries.push_back({query, SearchResults(arena), 0, false});
+
+    if (!searchBatch(queries, maxResults, deadline, arena))
+        return false;
+
+    results.insert(results.end(), queries[0].results.begin(), queries[0].results.end());
+    totalResults = queries[0].totalResults;
+    isPartial = queries[0].isPartial;
+
+    return true;
+}
+
+/**
+ * @brief Busca varias consultas juntas
+ *
+ * Cada palabra distinta del lote se resuelve a su term_id y se leen sus postings una
+ * sola vez, aunque aparezca en varias consultas; despus cada consulta acumula y
+ * ordena a partir de esos postings compartidos.
+ *
+ * Todo lo temporal (palabras, postings, acumuladores y resultados) se pide a arena,
+ * as que en rgimen estacionario la bsqueda no llama a malloc.
+ *
+ * Si se pasa el deadline, no se leen ms postings y cada consulta ordena lo que
+ * tenga hasta ese momento (siempre se lee al menos una palabra). Las palabras se
+ * procesan de la menos frecuente a la ms frecuente, as los resultados parciales
+ * priorizan las palabras ms selectivas.
+ *
+ * @param queries Las consultas; devuelve en cada una sus resultados
+ * @param maxResults Cantidad mxima de resultados por consulta
+ * @param deadline Momento a partir del cual se devuelven resultados parciales
+ * @param arena Memoria de la request
+ * @return true Bsqueda realizada
+ * @return false ndice no disponible
+ */
+bool SearchIndex::searchBatch(SearchQueries &queries,
+                              size_t maxResults,
+                              chrono::steady_clock::time_point deadline,
+                              pmr::memory_resource *arena)
+{
+    if (!db)
+        return false;
+
+    struct Term
+    {
+        int termId;
+        int df;
+        bool isRead;
+        pmr::vector<pair<int, int>> postings;
+    };
+
+    // Palabras de cada consulta. No se modifican ms, as que se pueden usar vistas a ellas.
+    pmr::vector<pmr::vector<pmr::string>> queryWords(arena);
+    queryWords.reserve(queries.size());
+    for (const auto &query : queries)
+    {
+        queryWords.emplace_back();
+        tokenizeQuery(query.query, queryWords.back());
+    }
+
+    // Resuelve cada palabra distinta a su term_id, una sola vez para todo el lote
+    pmr::vector<Term> terms(arena);
+    pmr::unordered_map<string_view, size_t> termIndexes(arena);    // palabra -> ndice en terms
+    pmr::vector<pmr::vector<size_t>> queryTerms(arena);
+    queryTerms.reserve(queries.size());
+    for (const auto &words : queryWords)
+    {
+        queryTerms.emplace_back();
+
+        for (const auto &word : words)
+        {
+            auto it = termIndexes.find(word);
+            if (it == termIndexes.end())
+            {
+                int termId, df;
+                if (!lookupTerm(word, termId, df))
+                    continue;
+
+                terms.push_back({termId, df, false, pmr::vector<pair<int, int>>(arena)});
+                it = termIndexes.emplace(word, terms.size() - 1).first;
+            }
+
+            queryTerms.back().push_back(it->second);
+        }
+    }
+
+    // Lee los postings de cada trmino, del menos frecuente al ms frecuente
+    pmr::vector<size_t> readOrder(arena);
+    for (size_t i = 0; i < terms.size(); i++)
+        readOrder.push_back(i);
+    sort(readOrder.begin(), readOrder.end(),
+         [&terms](size_t a, size_t b)
+         {
+             return terms[a].df < terms[b].df;
+         });
+
+    for (size_t i : readOrder)
+    {
+        // La palabra ms selectiva se lee siempre, para que haya algo que mostrar
+        if (i != readOrder.front() && chrono::steady_clock::now() >= deadline)
+            break;
+
+        terms[i].postings.reserve(terms[i].df);
+        readPostings(terms[i].termId, terms[i].postings);
+        terms[i].isRead = true;
+    }
+
+    for (size_t q = 0; q < queries.size(); q++)
+    {
+        SearchQuery &query = queries[q];
+        query.isPartial = false;
+
+        // Acumula la frecuencia total por doc_id
+        size_t postingsCount = 0;
+        for (size_t i : queryTerms[q])
+            postingsCount += terms[i].df;
+
+        pmr::unordered_map<int, int> docFrequencies(arena);
+        docFrequencies.reserve(postingsCount);
+        for (size_t i : queryTerms[q])
+        {
+            if (!terms[i].isRead)
+            {
+                query.isPartial = true;
+                continue;
+            }
+
+            for (const auto &posting : terms[i].postings)
+                docFrequencies[posting.first] += posting.second;
+        }
+
+        // Ordena por frecuencia total (descendente), solo lo necesario para los primeros maxResults
+        pmr::vector<pair<int, int>> ranking(docFrequencies.begin(), docFrequencies.end(), arena);
+        size_t topK = min(ranking.size(), maxResults);
+        partial_sort(ranking.begin(), ranking.begin() + topK, ranking.end(),
+                     [](const pair<int, int> &a, const pair<int, int> &b)
+                     {
+                         return a.second != b.second ? a.second > b.second : a.first < b.first;
+                     });
+
+        query.totalResults = ranking.size();
+
+        // Recin ahora se buscan las URLs, y solo de los documentos que se muestran
+        query.results.reserve(query.results.size() + topK);
+        for (size_t i = 0; i < topK; i++)
+            query.results.push_back({ranking[i].first, ranking[i].second, getUrl(ranking[i].first)});
+    }
+
+    return true;
+}
+
+/**
+ * @brief Separa la consulta en palabras con el mismo criterio que mkindex
+ *        (solo letras, en minscula), sin repetir palabras
+ */
+void tokenizeQuery(string_view query, pmr::vector<pmr::string> &words)
+{
+    pmr::string word(words.get_allocator());
+
+    for (size_t i = 0; i <= query.size(); i++)
+    {
+        unsigned char ch = i < query.size() ? query[i] : ' ';
+
+        if (isalpha(ch))
+            word += (char)tolower(ch);
+        else if (!word.empty())
+        {
+            if (find(words.begin(), words.end(), word) == words.end())
+                words.push_back(word);
+            word.clear();
+        }
+    }
+}
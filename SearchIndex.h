@@ -0,0 +1,93 @@
+/**
+ * @file SearchIndex.h
+ * @author Marc S. Ressl
+ * @brief EDAoogle search index
+ * @version 0.5
+ *
+ * @copyright Copyright (c) 2022-2024 Marc S. Ressl
+ */
+
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include <chrono>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sqlite3.h>
+
+struct SearchResult
+{
+    int docId;
+    int score;
+    std::string_view url;
+};
+
+typedef std::pmr::vector<SearchResult> SearchResults;
+
+struct SearchQuery
+{
+    std::string_view query;
+    SearchResults results;
+    size_t totalResults;
+    bool isPartial;
+};
+
+typedef std::pmr::vector<SearchQuery> SearchQueries;
+
+/**
+ * @brief URLs of all documents, loaded once. It is read-only afterwards, so it can be
+ *        shared by every connection (one copy per process, not one per thread).
+ */
+class UrlTable
+{
+public:
+    UrlTable(const std::string &databasePath);
+
+    bool isLoaded() const;
+    std::string_view getUrl(int docId) const;
+
+private:
+    // urls[urlOffsets[docId]..urlOffsets[docId + 1]]
+    std::string urls;
+    std::vector<size_t> urlOffsets;
+};
+
+class SearchIndex
+{
+public:
+    SearchIndex(const std::string &databasePath, std::shared_ptr<const UrlTable> urlTable = nullptr);
+    ~SearchIndex();
+
+    bool isOpen();
+
+    bool lookupTerm(std::string_view term, int &termId, int &df);
+    void readPostings(int termId, std::pmr::vector<std::pair<int, int>> &postings);
+    std::string_view getUrl(int docId);
+
+    bool search(std::string_view query,
+                size_t maxResults,
+                std::chrono::steady_clock::time_point deadline,
+                std::pmr::memory_resource *arena,
+                SearchResults &results,
+                size_t &totalResults,
+                bool &isPartial);
+    bool searchBatch(SearchQueries &queries,
+                     size_t maxResults,
+                     std::chrono::steady_clock::time_point deadline,
+                     std::pmr::memory_resource *arena);
+
+private:
+    sqlite3 *db;
+    sqlite3_stmt *termStmt;
+    sqlite3_stmt *postingsStmt;
+
+    std::shared_ptr<const UrlTable> urlTable;
+};
+
+void tokenizeQuery(std::string_view query, std::pmr::vector<std::pmr::string> &words);
+
+#endif
@@ -0,0 +1,603 @@
+/**
+ * @file SpimiIndexer.cpp
+ * @author Marc S. Ressl
+ * @brief Single-pass in-memory indexer with on-disk segments
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2024 Marc S. Ressl
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <queue>
+
+#include "SpimiIndexer.h"
+
+using namespace std;
+
+// Segment files are written and read sequentially through buffers of this size
+// (during the merge, the budget is split among the segments, down to the minimum)
+static const size_t SEGMENT_BUFFER_SIZE = 1024 * 1024;
+static const size_t MIN_SEGMENT_BUFFER_SIZE = 64 * 1024;
+
+// Segments merged at once, at most (each one is an open file)
+static const size_t MAX_MERGE_FAN_IN = 64;
+
+BlockArena::BlockArena(size_t blockSize)
+{
+    this->blockSize = blockSize;
+    current = NULL;
+    available = 0;
+    allocatedBytes = 0;
+}
+
+BlockArena::~BlockArena()
+{
+    release();
+}
+
+size_t BlockArena::getAllocatedBytes()
+{
+    return allocatedBytes;
+}
+
+/**
+ * @brief Frees every block. Everything allocated from the arena becomes invalid.
+ */
+void BlockArena::release()
+{
+    for (auto block : blocks)
+        delete[] block;
+
+    blocks.clear();
+    current = NULL;
+    available = 0;
+    allocatedBytes = 0;
+}
+
+void *BlockArena::do_allocate(size_t bytes, size_t alignment)
+{
+    size_t padding = (alignment - (size_t)current % alignment) % alignment;
+
+    if (!current || padding + bytes > available)
+    {
+        // Allocations larger than a block get a block of their own
+        size_t size = max(blockSize, bytes + alignment);
+
+        current = new char[size];
+        available = size;
+        blocks.push_back(current);
+        allocatedBytes += size;
+
+        padding = (alignment - (size_t)current % alignment) % alignment;
+    }
+
+    void *p = current + padding;
+    current += padding + bytes;
+    available -= padding + bytes;
+
+    return p;
+}
+
+void BlockArena::do_deallocate(void * /* p */, size_t /* bytes */, size_t /* alignment */)
+{
+}
+
+bool BlockArena::do_is_equal(const pmr::memory_resource &other) const noexcept
+{
+    return this == &other;
+}
+
+static void writeVarint(ostream &file, size_t value)
+{
+    while (value >= 0x80)
+    {
+        file.put((char)(value | 0x80));
+        value >>= 7;
+    }
+
+    file.put((char)value);
+}
+
+/**
+ * @return false End of file or malformed varint
+ */
+static bool readVarint(streambuf *buffer, size_t &value)
+{
+    value = 0;
+
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        int byte = buffer->sbumpc();
+        if (byte == char_traits<char>::eof())
+            return false;
+
+        value |= (size_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Destination of a k-way merge: receives each term, followed by its postings
+ */
+class MergeOutput
+{
+public:
+    virtual ~MergeOutput() {}
+
+    virtual bool addTerm(const string &term, size_t postingCount) = 0;
+    virtual bool addPosting(const Posting &posting) = 0;
+};
+
+/**
+ * @brief Sequential writer for a segment file
+ *
+ * Segment format, repeated for each term in lexicographic order:
+ * term length (varint), term, posting count (varint), and for each posting the
+ * doc_id delta from the previous posting (varint) and the frequency (varint).
+ * A term length of 0 ends the segment.
+ */
+class SegmentWriter : public MergeOutput
+{
+public:
+    SegmentWriter(const string &path, size_t bufferSize) : buffer(bufferSize)
+    {
+        this->path = path;
+        lastDocId = 0;
+
+        file.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+        file.open(path, ios::binary | ios::trunc);
+
+        if (!file.is_open())
+            cout << "Error al crear el segmento " << path << endl;
+    }
+
+    bool isOpen()
+    {
+        return file.is_open();
+    }
+
+    bool addTerm(const string &term, size_t postingCount) override
+    {
+        writeVarint(file, term.size());
+        file.write(term.data(), term.size());
+        writeVarint(file, postingCount);
+
+        lastDocId = 0;
+
+        return file.good();
+    }
+
+    bool addPosting(const Posting &posting) override
+    {
+        writeVarint(file, posting.docId - lastDocId);
+        writeVarint(file, posting.frequency);
+
+        lastDocId = posting.docId;
+
+        return file.good();
+    }
+
+    /**
+     * @brief Ends the segment and flushes it to disk
+     */
+    bool close()
+    {
+        writeVarint(file, 0);
+        file.close();
+
+        if (file.fail())
+        {
+            cout << "Error al escribir el segmento " << path << endl;
+            return false;
+        }
+
+        return true;
+    }
+
+private:
+    string path;
+    vector<char> buffer;
+    ofstream file;
+    int lastDocId;
+};
+
+/**
+ * @brief Sequential reader for a segment file (see SegmentWriter for the format)
+ */
+class SegmentReader
+{
+public:
+    SegmentReader(const string &path, int index, size_t bufferSize) : buffer(bufferSize)
+    {
+        this->path = path;
+        this->index = index;
+        remainingPostings = 0;
+        isCorrupt = false;
+        lastDocId = 0;
+
+        file.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+        file.open(path, ios::binary);
+    }
+
+    bool isOpen()
+    {
+        return file.is_open();
+    }
+
+    /**
+     * @return false End of the segment, or a truncated record (isCorrupt is set)
+     */
+    bool nextTerm()
+    {
+        size_t termLength;
+        if (!readVarint(file.rdbuf(), termLength))
+            return setCorrupt();
+
+        if (termLength == 0)
+            return false;
+
+        term.resize(termLength);
+        if ((size_t)file.rdbuf()->sgetn(term.data(), termLength) != termLength ||
+            !readVarint(file.rdbuf(), remainingPostings))
+            return setCorrupt();
+
+        lastDocId = 0;
+
+        return true;
+    }
+
+    /**
+     * @return false Truncated record (isCorrupt is set)
+     */
+    bool nextPosting(Posting &posting)
+    {
+        size_t docIdDelta, frequency;
+        if (!readVarint(file.rdbuf(), docIdDelta) ||
+            !readVarint(file.rdbuf(), frequency))
+            return setCorrupt();
+
+        posting.docId = lastDocId + (int)docIdDelta;
+        posting.frequency = (int)frequency;
+
+        lastDocId = posting.docId;
+        remainingPostings--;
+
+        return true;
+    }
+
+    string path;
+    int index;
+    string term;
+    size_t remainingPostings;
+    bool isCorrupt;
+
+private:
+    bool setCorrupt()
+    {
+        isCorrupt = true;
+
+        return false;
+    }
+
+    vector<char> buffer;
+    ifstream file;
+    int lastDocId;
+};
+
+/**
+ * @brief Writes the merged index into the terms and postings tables
+ *
+ * Terms arrive in lexicographic order, so term_ids follow that order, and every
+ * insert appends to the end of the terms and postings B-trees.
+ */
+class DatabaseWriter : public MergeOutput
+{
+public:
+    DatabaseWriter(sqlite3 *db)
+    {
+        this->db = db;
+        termId = 0;
+        postingStmt = NULL;
+
+        if (sqlite3_prepare_v2(db, "INSERT INTO terms (term_id, term, df) VALUES (?, ?, ?);", -1,
+                               &termStmt, nullptr) != SQLITE_OK)
+        {
+            cout << "Error al preparar la insercin de trminos: " << sqlite3_errmsg(db) << endl;
+            termStmt = NULL;
+            return;
+        }
+        if (sqlite3_prepare_v2(db, "INSERT INTO postings (term_id, doc_id, frequency) VALUES (?, ?, ?);", -1,
+                               &postingStmt, nullptr) != SQLITE_OK)
+        {
+            cout << "Error al preparar la insercin de postings: " << sqlite3_errmsg(db) << endl;
+            postingStmt = NULL;
+        }
+    }
+
+    ~DatabaseWriter()
+    {
+        sqlite3_finalize(termStmt);
+        sqlite3_finalize(postingStmt);
+    }
+
+    bool isReady()
+    {
+        return termStmt && postingStmt;
+    }
+
+    bool addTerm(const string &term, size_t postingCount) override
+    {
+        termId++;
+
+        sqlite3_bind_int(termStmt, 1, termId);
+        sqlite3_bind_text(termStmt, 2, term.c_str(), (int)term.size(), SQLITE_STATIC);
+        sqlite3_bind_int(termStmt, 3, (int)postingCount);
+
+        bool isInserted = sqlite3_step(termStmt) == SQLITE_DONE;
+        if (!isInserted)
+            cout << "Error al insertar el trmino: " << sqlite3_errmsg(db) << endl;
+
+        sqlite3_reset(termStmt);
+
+        return isInserted;
+    }
+
+    bool addPosting(const Posting &posting) override
+    {
+        sqlite3_bind_int(postingStmt, 1, termId);
+        sqlite3_bind_int(postingStmt, 2, posting.docId);
+        sqlite3_bind_int(postingStmt, 3, posting.frequency);
+
+        bool isInserted = sqlite3_step(postingStmt) == SQLITE_DONE;
+        if (!isInserted)
+            cout << "Error al insertar en la base de datos: " << sqlite3_errmsg(db) << endl;
+
+        sqlite3_reset(postingStmt);
+
+        return isInserted;
+    }
+
+private:
+    sqlite3 *db;
+    sqlite3_stmt *termStmt;
+    sqlite3_stmt *postingStmt;
+    int termId;
+};
+
+/**
+ * @brief k-way merge of segments
+ *
+ * Terms come out in lexicographic order. The segments must hold increasing doc_ids
+ * (each one after the previous), so for a given term they are copied in segment order.
+ *
+ * @param paths The segments, in doc_id order
+ * @param bufferSize Read buffer for each segment
+ * @param output Where the merged terms and postings go
+ * @return true Segments merged
+ * @return false A segment could not be read, or output failed
+ */
+static bool mergeSegments(const vector<string> &paths, size_t bufferSize, MergeOutput &output)
+{
+    auto isAfter = [](SegmentReader *a, SegmentReader *b)
+    {
+        int comparison = a->term.compare(b->term);
+
+        return comparison != 0 ? comparison > 0 : a->index > b->index;
+    };
+    priority_queue<SegmentReader *, vector<SegmentReader *>, decltype(isAfter)> heap(isAfter);
+
+    bool isMerged = true;
+
+    vector<SegmentReader *> readers;
+    for (size_t i = 0; i < paths.size(); i++)
+    {
+        readers.push_back(new SegmentReader(paths[i], (int)i, bufferSize));
+
+        if (!readers.back()->isOpen())
+        {
+            cout << "Error al abrir el segmento " << paths[i] << endl;
+            isMerged = false;
+        }
+        else if (readers.back()->nextTerm())
+            heap.push(readers.back());
+    }
+
+    // Segments that have the current term, in segment order
+    vector<SegmentReader *> termReaders;
+
+    while (isMerged && !heap.empty())
+    {
+        termReaders.clear();
+        do
+        {
+            termReaders.push_back(heap.top());
+            heap.pop();
+        } while (!heap.empty() && heap.top()->term == termReaders[0]->term);
+
+        size_t postingCount = 0;
+        for (auto reader : termReaders)
+            postingCount += reader->remainingPostings;
+
+        isMerged = output.addTerm(termReaders[0]->term, postingCount);
+
+        for (auto reader : termReaders)
+        {
+            while (isMerged && reader->remainingPostings > 0)
+            {
+                Posting posting;
+                isMerged = reader->nextPosting(posting) && output.addPosting(posting);
+            }
+
+            if (isMerged && reader->nextTerm())
+                heap.push(reader);
+        }
+    }
+
+    for (auto reader : readers)
+    {
+        if (reader->isCorrupt)
+        {
+            cout << "Error al leer el segmento " << reader->path << endl;
+            isMerged = false;
+        }
+
+        delete reader;
+    }
+
+    return isMerged;
+}
+
+SpimiIndexer::SpimiIndexer(const string &segmentPathPrefix, size_t memoryBudget) : arena(1024 * 1024)
+{
+    this->segmentPathPrefix = segmentPathPrefix;
+    this->memoryBudget = memoryBudget;
+    segmentCount = 0;
+    isSpillFailed = false;
+
+    dictionary.emplace(&arena);
+}
+
+SpimiIndexer::~SpimiIndexer()
+{
+    dictionary.reset();
+
+    for (auto &segmentPath : segmentPaths)
+        remove(segmentPath.c_str());
+}
+
+/**
+ * @brief Adds the postings of a document. Documents must arrive in increasing docId order.
+ */
+void SpimiIndexer::addDocument(int docId, const map<string, int> &frequencies)
+{
+    for (const auto &pair : frequencies)
+    {
+        // The lookup key comes from the default resource (short words don't allocate);
+        // only new terms get copied into the arena
+        auto &postings = (*dictionary)[pmr::string(pair.first.data(), pair.first.size())];
+
+        postings.push_back({docId, pair.second});
+    }
+
+    // A failed spill is reported by finish()
+    if (arena.getAllocatedBytes() >= memoryBudget && !spill())
+        isSpillFailed = true;
+}
+
+string SpimiIndexer::newSegmentPath()
+{
+    string segmentPath = segmentPathPrefix + to_string(segmentCount++);
+    segmentPaths.push_back(segmentPath);
+
+    return segmentPath;
+}
+
+/**
+ * @brief Writes the in-memory postings as a sorted segment and frees the arena
+ *
+ * @return true Segment written
+ * @return false I/O error
+ */
+bool SpimiIndexer::spill()
+{
+    if (dictionary->empty())
+        return true;
+
+    // Sorts the terms (the arena has no room left for this, so it comes from the heap)
+    vector<Dictionary::const_pointer> terms;
+    terms.reserve(dictionary->size());
+    for (const auto &entry : *dictionary)
+        terms.push_back(&entry);
+
+    sort(terms.begin(), terms.end(),
+         [](Dictionary::const_pointer a, Dictionary::const_pointer b)
+         {
+             return a->first < b->first;
+         });
+
+    SegmentWriter writer(newSegmentPath(), SEGMENT_BUFFER_SIZE);
+    bool isWritten = writer.isOpen();
+
+    string term;
+    for (size_t i = 0; isWritten && i < terms.size(); i++)
+    {
+        term.assign(terms[i]->first.data(), terms[i]->first.size());
+        isWritten = writer.addTerm(term, terms[i]->second.size());
+
+        for (const auto &posting : terms[i]->second)
+            writer.addPosting(posting);
+    }
+
+    if (isWritten)
+        isWritten = writer.close();
+
+    // The dictionary lives in the arena: it must go before the arena is released
+    dictionary.reset();
+    arena.release();
+    dictionary.emplace(&arena);
+
+    return isWritten;
+}
+
+/**
+ * @brief Writes the last segment and merges all segments into the terms and postings tables
+ *
+ * At most a fixed number of segments are merged at once, so that their read buffers fit
+ * in the memory budget (and the open files stay bounded). With more segments than that,
+ * the merge runs in several passes: each pass merges groups of consecutive segments
+ * into intermediate segments, until the last pass writes the database.
+ *
+ * @param db The database, inside a transaction, with empty terms and postings tables
+ * @return true Index written
+ * @return false I/O or database error
+ */
+bool SpimiIndexer::finish(sqlite3 *db)
+{
+    bool isIndexed = spill() && !isSpillFailed;
+
+    // One read buffer per input segment, plus one for the output segment
+    size_t fanIn = memoryBudget / MIN_SEGMENT_BUFFER_SIZE - 1;
+    fanIn = max((size_t)2, min(MAX_MERGE_FAN_IN, fanIn));
+
+    size_t bufferSize = memoryBudget / (fanIn + 1);
+    bufferSize = max(MIN_SEGMENT_BUFFER_SIZE, min(SEGMENT_BUFFER_SIZE, bufferSize));
+
+    while (isIndexed && segmentPaths.size() > fanIn)
+    {
+        vector<string> inputPaths;
+        inputPaths.swap(segmentPaths);
+
+        // Consecutive segments, so doc_ids still increase from one segment to the next
+        for (size_t i = 0; isIndexed && i < inputPaths.size(); i += fanIn)
+        {
+            vector<string> group(inputPaths.begin() + i,
+                                 inputPaths.begin() + min(i + fanIn, inputPaths.size()));
+
+            SegmentWriter writer(newSegmentPath(), bufferSize);
+            isIndexed = writer.isOpen() &&
+                        mergeSegments(group, bufferSize, writer) &&
+                        writer.close();
+        }
+
+        for (auto &inputPath : inputPaths)
+            remove(inputPath.c_str());
+    }
+
+    if (isIndexed)
+    {
+        DatabaseWriter writer(db);
+        isIndexed = writer.isReady() && mergeSegments(segmentPaths, bufferSize, writer);
+    }
+
+    for (auto &segmentPath : segmentPaths)
+        remove(segmentPath.c_str());
+    segmentPaths.clear();
+
+    return isIndexed;
+}
@@ -0,0 +1,79 @@
+/**
+ * @file SpimiIndexer.h
+ * @author Marc S. Ressl
+ * @brief Single-pass in-memory indexer with on-disk segments
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2024 Marc S. Ressl
+ */
+
+#ifndef SPIMIINDEXER_H
+#define SPIMIINDEXER_H
+
+#include <map>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <sqlite3.h>
+
+/**
+ * @brief Memory resource that hands out fixed-size blocks and frees them all at once
+ *        (like monotonic_buffer_resource, but without geometric growth, so the
+ *        memory in use can be compared against a budget)
+ */
+class BlockArena : public std::pmr::memory_resource
+{
+public:
+    BlockArena(size_t blockSize);
+    ~BlockArena();
+
+    size_t getAllocatedBytes();
+    void release();
+
+private:
+    void *do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void *p, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+
+    size_t blockSize;
+    std::vector<char *> blocks;
+    char *current;
+    size_t available;
+    size_t allocatedBytes;
+};
+
+struct Posting
+{
+    int docId;
+    int frequency;
+};
+
+class SpimiIndexer
+{
+public:
+    SpimiIndexer(const std::string &segmentPathPrefix, size_t memoryBudget);
+    ~SpimiIndexer();
+
+    void addDocument(int docId, const std::map<std::string, int> &frequencies);
+    bool finish(sqlite3 *db);
+
+private:
+    typedef std::pmr::unordered_map<std::pmr::string, std::pmr::vector<Posting>> Dictionary;
+
+    std::string newSegmentPath();
+    bool spill();
+
+    std::string segmentPathPrefix;
+    std::vector<std::string> segmentPaths;
+    int segmentCount;
+    size_t memoryBudget;
+    bool isSpillFailed;
+
+    BlockArena arena;
+    std::optional<Dictionary> dictionary;
+};
+
+#endif
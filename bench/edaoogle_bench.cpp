@@ -0,0 +1,800 @@
+/**
+ * @file edaoogle_bench.cpp
+ * @author Marc S. Ressl
+ * @brief EDAoogle component benchmarks
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2024 Marc S. Ressl
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <sqlite3.h>
+
+#include "../CommandLineParser.h"
+#include "../HttpRequestHandler.h"
+#include "../IndexBuilder.h"
+#include "../SearchIndex.h"
+#include "../SpimiIndexer.h"
+
+using namespace std;
+
+// Allocation counters: every operator new and every SQLite malloc goes through these
+static size_t newCount = 0;
+static size_t sqliteMallocCount = 0;
+
+void *operator new(size_t size)
+{
+    newCount++;
+
+    void *p = malloc(size ? size : 1);
+    if (!p)
+        throw bad_alloc();
+
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+static sqlite3_mem_methods sqliteDefaultMemMethods;
+
+static void *sqliteCountingMalloc(int size)
+{
+    sqliteMallocCount++;
+
+    return sqliteDefaultMemMethods.xMalloc(size);
+}
+
+static void *sqliteCountingRealloc(void *p, int size)
+{
+    sqliteMallocCount++;
+
+    return sqliteDefaultMemMethods.xRealloc(p, size);
+}
+
+static void installSqliteCounters()
+{
+    sqlite3_config(SQLITE_CONFIG_GETMALLOC, &sqliteDefaultMemMethods);
+
+    sqlite3_mem_methods countingMemMethods = sqliteDefaultMemMethods;
+    countingMemMethods.xMalloc = sqliteCountingMalloc;
+    countingMemMethods.xRealloc = sqliteCountingRealloc;
+    sqlite3_config(SQLITE_CONFIG_MALLOC, &countingMemMethods);
+}
+
+/**
+ * @brief Hardware counters through perf_event (Linux only). Counters the kernel
+ *        or the machine does not provide are reported as unavailable.
+ */
+class PerfCounters
+{
+public:
+    enum Counter
+    {
+        CYCLES,
+        INSTRUCTIONS,
+        CACHE_MISSES,
+        BRANCH_MISSES,
+        COUNTER_NUM,
+    };
+
+    PerfCounters()
+    {
+        for (int i = 0; i < COUNTER_NUM; i++)
+            fds[i] = -1;
+
+#ifdef __linux__
+        const unsigned long long configs[COUNTER_NUM] = {
+            PERF_COUNT_HW_CPU_CYCLES,
+            PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_MISSES,
+            PERF_COUNT_HW_BRANCH_MISSES,
+        };
+
+        for (int i = 0; i < COUNTER_NUM; i++)
+        {
+            perf_event_attr attr = {};
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[i];
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+
+            fds[i] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        }
+#endif
+    }
+
+    ~PerfCounters()
+    {
+#ifdef __linux__
+        for (int i = 0; i < COUNTER_NUM; i++)
+        {
+            if (fds[i] >= 0)
+                close(fds[i]);
+        }
+#endif
+    }
+
+    bool isAvailable(int counter)
+    {
+        return fds[counter] >= 0;
+    }
+
+    void start()
+    {
+#ifdef __linux__
+        for (int i = 0; i < COUNTER_NUM; i++)
+        {
+            if (fds[i] >= 0)
+            {
+                ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+                ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+#endif
+    }
+
+    void stop(double values[COUNTER_NUM])
+    {
+        for (int i = 0; i < COUNTER_NUM; i++)
+        {
+            values[i] = 0;
+
+#ifdef __linux__
+            if (fds[i] >= 0)
+            {
+                ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+
+                unsigned long long value;
+                if (read(fds[i], &value, sizeof(value)) == sizeof(value))
+                    values[i] = (double)value;
+            }
+#endif
+        }
+    }
+
+private:
+    int fds[COUNTER_NUM];
+};
+
+static const char *counterNames[PerfCounters::COUNTER_NUM] = {
+    "cycles_per_op",
+    "instructions_per_op",
+    "cache_misses_per_op",
+    "branch_misses_per_op",
+};
+
+struct BenchmarkResult
+{
+    string name;
+    string unit;
+    size_t iterations;
+    double nsPerOp;
+    double unitsPerSecond;
+    double newPerOp;
+    double sqliteMallocPerOp;
+    bool hasCounter[PerfCounters::COUNTER_NUM];
+    double counterPerOp[PerfCounters::COUNTER_NUM];
+};
+
+/**
+ * @brief Runs and measures benchmarks
+ *
+ * Each operation returns how many units it processed (bytes, postings, queries...),
+ * so throughput is reported in those units. The number of iterations grows until a
+ * batch runs for at least the minimum time; the last batch is the one reported.
+ */
+class BenchmarkRunner
+{
+public:
+    BenchmarkRunner(double minTime, const string &filter)
+    {
+        this->minTime = minTime;
+        this->filter = filter;
+    }
+
+    bool isSelected(const string &name)
+    {
+        return filter.empty() || name.find(filter) != string::npos;
+    }
+
+    /**
+     * @param setup Runs before each iteration, outside the measurement (optional)
+     */
+    void run(const string &name, const string &unit, function<size_t()> op, function<void()> setup = nullptr)
+    {
+        if (!isSelected(name))
+            return;
+
+        BenchmarkResult result;
+        result.name = name;
+        result.unit = unit;
+
+        size_t iterations = 1;
+
+        // Warm up: page cache, statement caches, arenas
+        if (setup)
+            setup();
+        op();
+
+        while (true)
+        {
+            size_t units = 0;
+            size_t newCountSum = 0;
+            size_t sqliteMallocCountSum = 0;
+            double elapsed = 0;
+            double counters[PerfCounters::COUNTER_NUM] = {};
+
+            // Without setup, the whole batch is measured at once; with setup, each iteration on its own
+            size_t batchSize = setup ? 1 : iterations;
+            for (size_t done = 0; done < iterations; done += batchSize)
+            {
+                if (setup)
+                    setup();
+
+                size_t newCountStart = newCount;
+                size_t sqliteMallocCountStart = sqliteMallocCount;
+                double batchCounters[PerfCounters::COUNTER_NUM];
+
+                perfCounters.start();
+                auto start = chrono::steady_clock::now();
+
+                for (size_t i = 0; i < batchSize; i++)
+                    units += op();
+
+                elapsed += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+                perfCounters.stop(batchCounters);
+
+                newCountSum += newCount - newCountStart;
+                sqliteMallocCountSum += sqliteMallocCount - sqliteMallocCountStart;
+                for (int i = 0; i < PerfCounters::COUNTER_NUM; i++)
+                    counters[i] += batchCounters[i];
+            }
+
+            if (elapsed >= minTime)
+            {
+                result.iterations = iterations;
+                result.nsPerOp = elapsed * 1e9 / iterations;
+                result.unitsPerSecond = elapsed > 0 ? units / elapsed : 0;
+                result.newPerOp = (double)newCountSum / iterations;
+                result.sqliteMallocPerOp = (double)sqliteMallocCountSum / iterations;
+                for (int i = 0; i < PerfCounters::COUNTER_NUM; i++)
+                {
+                    result.hasCounter[i] = perfCounters.isAvailable(i);
+                    result.counterPerOp[i] = counters[i] / iterations;
+                }
+
+                break;
+            }
+
+            // Aims a bit past the minimum time, growing at most 10x per step
+            double factor = elapsed > 0 ? minTime * 1.2 / elapsed : 10;
+            iterations = (size_t)(iterations * min(10.0, max(2.0, factor)));
+        }
+
+        print(result);
+        results.push_back(result);
+    }
+
+    vector<BenchmarkResult> &getResults()
+    {
+        return results;
+    }
+
+private:
+    void print(const BenchmarkResult &result)
+    {
+        cout << left << setw(28) << result.name << right
+             << setw(12) << result.iterations << " it"
+             << setw(14) << fixed << setprecision(1) << result.nsPerOp << " ns/op";
+
+        if (result.unit == "bytes")
+            cout << setw(12) << setprecision(1) << result.unitsPerSecond / (1024 * 1024) << " MB/s";
+        else
+            cout << setw(12) << setprecision(0) << result.unitsPerSecond << " " << result.unit << "/s";
+
+        cout << setw(10) << setprecision(1) << result.newPerOp << " new/op"
+             << setw(10) << setprecision(1) << result.sqliteMallocPerOp << " sqlite/op";
+
+        if (result.hasCounter[PerfCounters::CYCLES] && result.hasCounter[PerfCounters::INSTRUCTIONS])
+            cout << setw(12) << setprecision(0) << result.counterPerOp[PerfCounters::CYCLES] << " cycles/op"
+                 << setw(6) << setprecision(2)
+                 << result.counterPerOp[PerfCounters::INSTRUCTIONS] / max(1.0, result.counterPerOp[PerfCounters::CYCLES])
+                 << " IPC";
+
+        cout << endl;
+    }
+
+    double minTime;
+    string filter;
+    PerfCounters perfCounters;
+    vector<BenchmarkResult> results;
+};
+
+/**
+ * @brief Writes the results as CSV (one row per benchmark; unavailable counters are empty)
+ */
+static bool writeResults(const string &path, const vector<BenchmarkResult> &results)
+{
+    ofstream file(path);
+    if (file.fail())
+        return false;
+
+    file << "name,unit,iterations,ns_per_op,units_per_second,new_per_op,sqlite_malloc_per_op";
+    for (int i = 0; i < PerfCounters::COUNTER_NUM; i++)
+        file << "," << counterNames[i];
+    file << endl;
+
+    file << setprecision(10);
+    for (auto &result : results)
+    {
+        file << result.name << "," << result.unit << "," << result.iterations << ","
+             << result.nsPerOp << "," << result.unitsPerSecond << ","
+             << result.newPerOp << "," << result.sqliteMallocPerOp;
+
+        for (int i = 0; i < PerfCounters::COUNTER_NUM; i++)
+        {
+            file << ",";
+            if (result.hasCounter[i])
+                file << result.counterPerOp[i];
+        }
+        file << endl;
+    }
+
+    return !file.fail();
+}
+
+/**
+ * @brief Reads ns_per_op of each benchmark from a CSV written by writeResults
+ *
+ * Rows that don't parse (e.g. after a hand edit) are reported and skipped.
+ */
+static bool readBaseline(const string &path, map<string, double> &baseline)
+{
+    ifstream file(path);
+    if (file.fail())
+        return false;
+
+    string line;
+    getline(file, line);
+
+    int lineNumber = 1;
+    while (getline(file, line))
+    {
+        lineNumber++;
+        if (line.empty())
+            continue;
+
+        stringstream row(line);
+        string name, unit, iterations, nsPerOp;
+
+        if (getline(row, name, ',') && getline(row, unit, ',') &&
+            getline(row, iterations, ',') && getline(row, nsPerOp, ','))
+        {
+            char *end = NULL;
+            double value = strtod(nsPerOp.c_str(), &end);
+
+            if (!name.empty() && !nsPerOp.empty() && *end == '\0' && value > 0)
+            {
+                baseline[name] = value;
+                continue;
+            }
+        }
+
+        cout << "warning: skipping malformed row " << lineNumber << " of " << path << endl;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Compares against a baseline
+ *
+ * @return int Number of benchmarks that got slower by more than threshold (in %)
+ */
+static int compareWithBaseline(const vector<BenchmarkResult> &results,
+                               const map<string, double> &baseline,
+                               double threshold)
+{
+    int regressions = 0;
+
+    cout << endl
+         << "Comparison with baseline (threshold " << threshold << "%):" << endl;
+
+    for (auto &result : results)
+    {
+        auto it = baseline.find(result.name);
+        if (it == baseline.end() || it->second <= 0)
+        {
+            cout << left << setw(28) << result.name << right << setw(12) << "new" << endl;
+            continue;
+        }
+
+        double change = (result.nsPerOp / it->second - 1) * 100;
+        bool isRegression = change > threshold;
+        if (isRegression)
+            regressions++;
+
+        cout << left << setw(28) << result.name << right
+             << setw(14) << fixed << setprecision(1) << it->second << " ns/op ->"
+             << setw(14) << result.nsPerOp << " ns/op"
+             << setw(9) << showpos << change << noshowpos << "%"
+             << (isRegression ? "  REGRESSION" : "") << endl;
+    }
+
+    return regressions;
+}
+
+/**
+ * @brief Picks words for the query fixtures: mid-frequency terms (not stopwords, not typos)
+ */
+static vector<string> loadQueryTerms(const string &databasePath, int minDf, int maxDf)
+{
+    vector<string> terms;
+
+    sqlite3 *db;
+    if (sqlite3_open_v2(databasePath.c_str(), &db, SQLITE_OPEN_READONLY, NULL) == SQLITE_OK)
+    {
+        sqlite3_stmt *stmt;
+        if (sqlite3_prepare_v2(db, "SELECT term FROM terms WHERE df BETWEEN ? AND ? ORDER BY term_id", -1,
+                               &stmt, NULL) == SQLITE_OK)
+        {
+            sqlite3_bind_int(stmt, 1, minDf);
+            sqlite3_bind_int(stmt, 2, maxDf);
+
+            while (sqlite3_step(stmt) == SQLITE_ROW)
+                terms.push_back(reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0)));
+        }
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_close(db);
+
+    return terms;
+}
+
+/**
+ * @brief Builds count queries of wordCount words each, always the same ones
+ */
+static vector<string> makeQueries(const vector<string> &terms, int wordCount, int count)
+{
+    vector<string> queries;
+    unsigned int seed = 12345 + wordCount;
+
+    for (int i = 0; i < count && !terms.empty(); i++)
+    {
+        string query;
+        for (int j = 0; j < wordCount; j++)
+        {
+            seed = seed * 1103515245 + 12345;
+            if (j)
+                query += " ";
+            query += terms[(seed >> 8) % terms.size()];
+        }
+        queries.push_back(query);
+    }
+
+    return queries;
+}
+
+void printHelp()
+{
+    cout << "Usage: edaoogle_bench -w WWW_PATH -d DATABASE_PATH [-f FILTER] [-t MIN_TIME_S]" << endl
+         << "                      [-o RESULTS.csv] [-b BASELINE.csv] [--threshold PERCENT]" << endl;
+}
+
+int main(int argc, const char *argv[])
+{
+    CommandLineParser parser(argc, argv);
+
+    if (!parser.hasOption("-w") || !parser.hasOption("-d"))
+    {
+        cout << "error: WWW_PATH and DATABASE_PATH must be specified." << endl;
+
+        printHelp();
+
+        return 1;
+    }
+
+    string wwwPath = parser.getOption("-w");
+    string databasePath = parser.getOption("-d");
+
+    double minTime = 0.5;
+    if (parser.hasOption("-t"))
+        minTime = stod(parser.getOption("-t"));
+
+    double threshold = 10;
+    if (parser.hasOption("--threshold"))
+        threshold = stod(parser.getOption("--threshold"));
+
+    // Must run before SQLite initializes
+    installSqliteCounters();
+
+    BenchmarkRunner runner(minTime, parser.getOption("-f"));
+
+    // Corpus fixtures
+    vector<string> wikiFiles;
+    for (const auto &entry : filesystem::directory_iterator(filesystem::path(wwwPath) / "wiki"))
+        wikiFiles.push_back(entry.path().filename().string());
+    sort(wikiFiles.begin(), wikiFiles.end());
+
+    if (wikiFiles.empty())
+    {
+        cout << "error: no pages in " << wwwPath << "/wiki" << endl;
+
+        return 1;
+    }
+
+    vector<string> queryTerms = loadQueryTerms(databasePath, 20, 400);
+    if (queryTerms.empty())
+    {
+        cout << "error: could not read terms from " << databasePath << endl;
+
+        return 1;
+    }
+
+    // Tokenization
+    {
+        size_t i = 0;
+        runner.run("tokenize/extraerPalabras", "bytes", [&]()
+        {
+            filesystem::path path = filesystem::path(wwwPath) / "wiki" / wikiFiles[i++ % wikiFiles.size()];
+            extraerPalabras(path.string());
+
+            return (size_t)filesystem::file_size(path);
+        });
+    }
+
+    // Index construction: postings into the SPIMI indexer, then the merge into SQLite
+    if (runner.isSelected("index/insert") || runner.isSelected("index/merge"))
+    {
+        const size_t FIXTURE_DOCUMENTS = 200;
+
+        vector<map<string, int>> documents;
+        for (size_t i = 0; i < FIXTURE_DOCUMENTS && i < wikiFiles.size(); i++)
+            documents.push_back(extraerPalabras((filesystem::path(wwwPath) / "wiki" / wikiFiles[i]).string()));
+
+        string indexPath = (filesystem::temp_directory_path() / "edaoogle_bench.db").string();
+        filesystem::remove(indexPath);
+
+        {
+            SpimiIndexer indexer(indexPath + ".segment", 64 * 1024 * 1024);
+            int docId = 0;
+
+            runner.run("index/insert", "postings", [&]()
+            {
+                auto &document = documents[docId % documents.size()];
+                indexer.addDocument(++docId, document);
+
+                return document.size();
+            });
+        }
+
+        // The merge always gets the same work: the same documents, spilled with
+        // the same small budget, so the same segments every time
+        {
+            const size_t MERGE_DOCUMENTS = 50;
+            const size_t MERGE_MEMORY_BUDGET = 1024 * 1024;
+
+            size_t postingsCount = 0;
+            for (size_t i = 0; i < MERGE_DOCUMENTS && i < documents.size(); i++)
+                postingsCount += documents[i].size();
+
+            sqlite3 *db = NULL;
+            unique_ptr<SpimiIndexer> indexer;
+
+            bool isMergeFailed = false;
+
+            runner.run("index/merge", "postings", [&]()
+            {
+                if (!indexer->finish(db))
+                    isMergeFailed = true;
+                sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+
+                return postingsCount;
+            }, [&]()
+            {
+                // A new database and a new indexer with the fixture's segments
+                indexer.reset();
+                sqlite3_close(db);
+                filesystem::remove(indexPath);
+
+                sqlite3_open(indexPath.c_str(), &db);
+                crearTablas(db);
+                sqlite3_exec(db, "BEGIN TRANSACTION;", 0, 0, 0);
+
+                indexer = make_unique<SpimiIndexer>(indexPath + ".segment", MERGE_MEMORY_BUDGET);
+                for (size_t i = 0; i < MERGE_DOCUMENTS && i < documents.size(); i++)
+                    indexer->addDocument((int)i + 1, documents[i]);
+            });
+
+            indexer.reset();
+            sqlite3_close(db);
+            filesystem::remove(indexPath);
+
+            // A failed merge must not be reported (or saved) as a valid result
+            if (isMergeFailed)
+            {
+                cout << "error: index/merge failed" << endl;
+
+                return 1;
+            }
+        }
+
+        filesystem::remove(indexPath);
+    }
+
+    // Search
+    {
+        SearchIndex searchIndex(databasePath);
+        if (!searchIndex.isOpen())
+        {
+            cout << "error: could not open " << databasePath << endl;
+
+            return 1;
+        }
+
+        // Same per-request arena as HttpRequestHandler::handleRequest
+        alignas(max_align_t) static char arenaBuffer[256 * 1024];
+        auto far = chrono::steady_clock::time_point::max();
+
+        {
+            size_t i = 0;
+            runner.run("search/lookupTerm", "lookups", [&]()
+            {
+                int termId, df;
+                searchIndex.lookupTerm(queryTerms[(i++ * 7919) % queryTerms.size()], termId, df);
+
+                return (size_t)1;
+            });
+        }
+
+        for (int wordCount : {1, 2, 5})
+        {
+            vector<string> queries = makeQueries(queryTerms, wordCount, 64);
+            size_t i = 0;
+
+            runner.run("search/" + to_string(wordCount) + (wordCount == 1 ? "_term" : "_terms"), "queries", [&]()
+            {
+                pmr::monotonic_buffer_resource arena(arenaBuffer, sizeof(arenaBuffer));
+                SearchResults results(&arena);
+                size_t totalResults;
+                bool isPartial;
+
+                searchIndex.search(queries[i++ % queries.size()], 100, far, &arena,
+                                   results, totalResults, isPartial);
+
+                return (size_t)1;
+            });
+        }
+
+        {
+            vector<string> queries = makeQueries(queryTerms, 2, 64);
+
+            runner.run("search/batch_64x2_terms", "queries", [&]()
+            {
+                pmr::monotonic_buffer_resource arena(arenaBuffer, sizeof(arenaBuffer));
+                SearchQueries batch(&arena);
+                for (auto &query : queries)
+                    batch.push_back({query, SearchResults(&arena), 0, false});
+
+                searchIndex.searchBatch(batch, 100, far, &arena);
+
+                return queries.size();
+            });
+        }
+
+        // Rendering
+        {
+            string query = makeQueries(queryTerms, 2, 1)[0];
+
+            pmr::monotonic_buffer_resource arena;
+            SearchResults results(&arena);
+            size_t totalResults;
+            bool isPartial;
+            searchIndex.search(query, 100, far, &arena, results, totalResults, isPartial);
+
+            vector<char> response;
+            runner.run("render/results_page", "bytes", [&]()
+            {
+                renderSearchPage(query, results, totalResults, isPartial, 0.001F, response);
+
+                return response.size();
+            });
+        }
+    }
+
+    // Request handling (static files go through HttpRequestHandler::serve)
+    {
+        HttpRequestHandler httpRequestHandler(wwwPath, databasePath);
+        HttpArguments noArguments;
+        HttpResponseHeaders headers;
+        vector<char> response;
+        auto far = chrono::steady_clock::time_point::max();
+
+        runner.run("serve/index_html", "bytes", [&]()
+        {
+            httpRequestHandler.handleRequest("GET", "/index.html", noArguments, "", far, headers, response);
+
+            return response.size();
+        });
+
+        {
+            size_t i = 0;
+            runner.run("serve/wiki_page", "bytes", [&]()
+            {
+                string url = "/wiki/" + wikiFiles[i++ % 64 % wikiFiles.size()];
+                httpRequestHandler.handleRequest("GET", url, noArguments, "", far, headers, response);
+
+                return response.size();
+            });
+        }
+
+        {
+            vector<string> queries = makeQueries(queryTerms, 2, 64);
+            size_t i = 0;
+
+            runner.run("handle/search", "queries", [&]()
+            {
+                HttpArguments arguments;
+                arguments.set("q", queries[i++ % queries.size()]);
+                httpRequestHandler.handleRequest("GET", "/search", arguments, "", far, headers, response);
+
+                return (size_t)1;
+            });
+        }
+    }
+
+    if (parser.hasOption("-o") && !writeResults(parser.getOption("-o"), runner.getResults()))
+    {
+        cout << "error: could not write " << parser.getOption("-o") << endl;
+
+        return 1;
+    }
+
+    if (parser.hasOption("-b"))
+    {
+        map<string, double> baseline;
+        if (!readBaseline(parser.getOption("-b"), baseline))
+        {
+            cout << "error: could not read " << parser.getOption("-b") << endl;
+
+            return 1;
+        }
+
+        if (compareWithBaseline(runner.getResults(), baseline, threshold) > 0)
+            return 2;
+    }
+
+    return 0;
+}
@@ -19,7 +19,7 @@ using namespace std;
 
 void printHelp()
 {
-    cout << "Usage: edahttpd -h WWW_PATH [-p PORT] " << endl;
+    cout << "Usage: edahttpd -h WWW_PATH [-d DATABASE_PATH] [-p PORT] [-w WORKERS] [-q QUEUE_SIZE] [-t TIMEOUT_MS]" << endl;
 };
 
 int main(int argc, const char *argv[])
@@ -28,7 +28,11 @@ int main(int argc, const char *argv[])
 
     // Configuration
     int port = 8000;
+    int workerCount = 4;
+    int queueCapacity = 64;
+    int queryTimeout = 250;
     string wwwPath;
+    string databasePath = "C:/Users/dante/OneDrive/Documentos/git/edaoogle2/search_index.db";
 
     // Parse command line
     if (!parser.hasOption("-h"))
@@ -42,13 +46,35 @@ int main(int argc, const char *argv[])
    
     wwwPath = parser.getOption("-h");
 
+    if (parser.hasOption("-d"))
+        databasePath = parser.getOption("-d");
+
     if (parser.hasOption("-p"))
         port = stoi(parser.getOption("-p"));
 
-    // Start server
-    HttpServer server(port);
+    if (parser.hasOption("-w"))
+        workerCount = stoi(parser.getOption("-w"));
+
+    if (parser.hasOption("-q"))
+        queueCapacity = stoi(parser.getOption("-q"));
+
+    if (parser.hasOption("-t"))
+        queryTimeout = stoi(parser.getOption("-t"));
+
+    if (workerCount < 1 || queueCapacity < 0 || queryTimeout <= 0)
+    {
+        cout << "error: WORKERS must be at least 1, QUEUE_SIZE at least 0 and TIMEOUT_MS positive." << endl;
+
+        printHelp();
+
+        return 1;
+    }
+
+    // Start server. The handler is declared first so that it outlives the server:
+    // the server's destructor waits for the requests still running on its workers.
+    HttpRequestHandler edaOogleHttpRequestHandler(wwwPath, databasePath);
 
-    HttpRequestHandler edaOogleHttpRequestHandler(wwwPath);
+    HttpServer server(port, workerCount, queueCapacity, chrono::milliseconds(queryTimeout));
     server.setHttpRequestHandler(&edaOogleHttpRequestHandler);
 
     if (server.isRunning())
@@ -2,7 +2,7 @@
  * @file mkindex.cpp
  * @author Marc S. Ressl
  * @brief Makes a database index
- * @version 0.3
+ * @version 0.7
  *
  * @copyright Copyright (c) 2022-2024 Marc S. Ressl
  */
@@ -15,10 +15,18 @@
 
 #include <sqlite3.h>
 
+#include "CommandLineParser.h"
+#include "IndexBuilder.h"
+#include "SpimiIndexer.h"
+
 using namespace std;
 
-map<string, int> extraerPalabras(const std::string& archivo);
-void guardarPalabrasEnDatabase(sqlite3* db, const map<string, int>& frecuenciaPalabras, const string& url);
+int guardarDocumentoEnDatabase(sqlite3* db, const string& url, const string& titulo, int longitud);
+
+void printHelp()
+{
+	cout << "Usage: mkindex [-d DATABASE_PATH] [-w WWW_PATH] [--mem MEMORY_MB]" << endl;
+}
 
 static int onDatabaseEntry(void* userdata,
 	int argc,
@@ -39,41 +47,42 @@ static int onDatabaseEntry(void* userdata,
 
 int main(int argc, const char* argv[])
 {
+	CommandLineParser parser(argc, argv);
+
+	// Memoria para los postings en RAM: al llenarse se vuelcan a un segmento en disco
+	size_t memoria = 256;
+	if (parser.hasOption("--mem")) {
+		memoria = stoul(parser.getOption("--mem"));
+		if (memoria == 0) {
+			printHelp();
+			return 1;
+		}
+	}
+
 	/*------------CREACION Y CONFIGURACION DE LA BASE DE DATOS------------*/
+	string databasePath = "C:/Users/dante/OneDrive/Documentos/git/edaoogle2/search_index.db";
+	if (parser.hasOption("-d"))
+		databasePath = parser.getOption("-d");
+
 	sqlite3* db;
-	char* errMsg = 0;
-	const char* sql;
 
 	// Abrir la base de datos
-	if (sqlite3_open("C:/Users/dante/OneDrive/Documentos/git/edaoogle2/search_index.db", &db)) {
+	if (sqlite3_open(databasePath.c_str(), &db)) {
 		cout << "Error al abrir la base de datos: " << sqlite3_errmsg(db) << endl;
 		return 1;
 	}
 
-	// Crear tabla para almacenar palabras clave, URLs y frecuencia de aparicin
-	sql = "CREATE TABLE IF NOT EXISTS keyword_index ("
-		"id INTEGER PRIMARY KEY, "
-		"keyword TEXT NOT NULL, "
-		"url TEXT NOT NULL, "
-		"frequency INTEGER NOT NULL);"; // Columna para frecuencia
-
-	if (sqlite3_exec(db, sql, 0, 0, &errMsg) != SQLITE_OK) {
-		cout << "Error al crear la tabla: " << errMsg << endl;
-		sqlite3_free(errMsg);
-	}
-
-	// Crear ndice en la columna de palabras clave para agilizar las bsquedas
-	sql = "CREATE INDEX IF NOT EXISTS idx_keyword ON keyword_index(keyword);";
-
-	if (sqlite3_exec(db, sql, 0, 0, &errMsg) != SQLITE_OK) {
-		cout << "Error al crear el ndice: " << errMsg << endl;
-		sqlite3_free(errMsg);
+	if (!crearTablas(db)) {
+		sqlite3_close(db);
+		return 1;
 	}
 
 	/*------------FIN DE LA CREACION Y CONFIGURACION DE LA BASE DE DATOS------------*/
 
 	/*------------MANIPULACION DE ARCHIVOS Y RELLENO DE LA BASE DE DATOS------------*/
 	string path = "C:/Users/dante/OneDrive/Documentos/git/edaoogle2/www/wiki";
+	if (parser.hasOption("-w"))
+		path = (filesystem::path(parser.getOption("-w")) / "wiki").string();
 
 	// Comprobamos si la ruta existe
 	if (!filesystem::exists(path)) {
@@ -81,15 +90,39 @@ int main(int argc, const char* argv[])
 		return 1;
 	}
 
+	// Indexado SPIMI: los postings se acumulan en memoria hasta llenar el presupuesto, se vuelcan
+	// ordenados a segmentos junto a la base de datos, y al final se mezclan (k-way merge)
+	// escribiendo terms y postings en orden, de forma secuencial
+	SpimiIndexer indexer(databasePath + ".segment", memoria * 1024 * 1024);
+
+	// Una sola transaccin para toda la carga, en lugar de una por cada INSERT
+	sqlite3_exec(db, "BEGIN TRANSACTION;", 0, 0, 0);
+
 	// Iteramos sobre los archivos en la carpeta
 	for (const auto& entrada : filesystem::directory_iterator(path)) {
 
 		const string archivo_path = entrada.path().string();
 		const string archivo_nombre = entrada.path().filename().string();
 		map<string, int> mapa = extraerPalabras(archivo_path);
-		guardarPalabrasEnDatabase(db, mapa, archivo_nombre);
 
+		int longitud = 0;
+		for (const auto& pair : mapa)
+			longitud += pair.second;
+
+		int docId = guardarDocumentoEnDatabase(db, archivo_nombre, extraerTitulo(archivo_path), longitud);
+		if (docId < 0)
+			continue;
+
+		indexer.addDocument(docId, mapa);
 	}
+
+	if (!indexer.finish(db)) {
+		sqlite3_exec(db, "ROLLBACK;", 0, 0, 0);
+		sqlite3_close(db);
+		return 1;
+	}
+
+	sqlite3_exec(db, "COMMIT;", 0, 0, 0);
 	/*------------FIN DE MANIPULACION DE ARCHIVOS Y RELLENO DE LA BASE DE DATOS------------*/
 
 	cout << "ndice de bsqueda creado, y datos insertados exitosamente." << endl;
@@ -99,69 +132,25 @@ int main(int argc, const char* argv[])
 	return 0;
 }
 
-map<string, int> extraerPalabras(const string& nombreArchivo) {
-	ifstream archivo(nombreArchivo);
-	map<string, int> frecuenciaPalabras;
-	string linea;
-	char brackets = 0;
-
-	// Leer el archivo lnea por lnea
-	while (getline(archivo, linea)) {
-		string palabra;
-
-		// Recorrer cada carcter en la lnea
-		for (char& ch : linea) {
-			if (ch == '<') {
-				brackets = 1;
-				continue;
-			}
-			else if (ch == '>') {
-				brackets = 0;
-				continue;
-			}
-
-			// Si estamos dentro de una etiqueta, ignoramos el carcter
-			if (brackets == 1) {
-				continue;
-			}
-
-			if (isalpha(static_cast<unsigned char>(ch))) {
-				palabra += tolower(static_cast<unsigned char>(ch));
-			}
-			else if (!palabra.empty()) {
-				// Si no es una letra y tenemos caracteres en la palabra, pasamos a terminar de evaluarla
-				frecuenciaPalabras[palabra]++;
-				palabra.clear(); // Reiniciar la palabra
-			}
-		}
+int guardarDocumentoEnDatabase(sqlite3* db, const string& url, const string& titulo, int longitud) {
+	const char* sql = "INSERT INTO documents (url, title, length) VALUES (?, ?, ?);";
+	sqlite3_stmt* stmt;
 
-		// Captura la ltima palabra en la lnea (por si el ultimo caracter fue una letra)
-		if (!palabra.empty()) {
-			frecuenciaPalabras[palabra]++;
-		}
+	if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+		cout << "Error al preparar la insercin del documento: " << sqlite3_errmsg(db) << endl;
+		return -1;
 	}
 
-	return frecuenciaPalabras;
-}
+	sqlite3_bind_text(stmt, 1, url.c_str(), -1, SQLITE_STATIC);
+	sqlite3_bind_text(stmt, 2, titulo.c_str(), -1, SQLITE_STATIC);
+	sqlite3_bind_int(stmt, 3, longitud);
 
-void guardarPalabrasEnDatabase(sqlite3* db, const map<string, int> &frecuenciaPalabras, const string& url) {
-	char* errMsg = 0;
-	for (const auto& pair : frecuenciaPalabras) {
-		string palabra = pair.first;
-		int frecuencia = pair.second;
-
-		// Preparar consulta SQL
-		string sql = "INSERT INTO keyword_index (keyword, url, frequency) VALUES ('" +
-			palabra + 
-			"', '" + 
-			url + 
-			"', " + 
-			to_string(frecuencia) + ");";
-
-		// Ejecutar consulta
-		if (sqlite3_exec(db, sql.c_str(), 0, 0, &errMsg) != SQLITE_OK) {
-			cout << "Error al insertar en la base de datos: " << errMsg << endl;
-			sqlite3_free(errMsg);
-		}
-	}
-}
\ No newline at end of file
+	int docId = -1;
+	if (sqlite3_step(stmt) == SQLITE_DONE)
+		docId = (int)sqlite3_last_insert_rowid(db);
+	else
+		cout << "Error al insertar el documento: " << sqlite3_errmsg(db) << endl;
+
+	sqlite3_finalize(stmt);
+	return docId;
+}